@@ -18,6 +18,9 @@
 #include <string.h>
 #include <time.h>
 #include <unistd.h>
+#ifdef MM_THREADS
+#include <pthread.h>
+#endif
 
 
 #include "mm.h"
@@ -31,6 +34,9 @@
 
 /* Misc */
 #define MAXLINE     1024 /* max string size */
+#define MAXOPTS       16 /* max number of -o allocator options */
+#define MAXVARIANTS   16 /* max number of values compared by one -o option */
+#define MAXTHREADS    64 /* max number of -T replay threads */
 #define HDRLINES       4 /* number of header lines in a trace file */
 #define LINENUM(i) (i+5) /* cnvt trace request nums to linenums (origin 1) */
 
@@ -64,9 +70,12 @@ typedef struct range_t {
 
 /* Characterizes a single trace operation (allocator request) */
 typedef struct {
-    enum { ALLOC, FREE, REALLOC } type; /* type of request */
+    enum { ALLOC, FREE, REALLOC, MEMALIGN,
+           BATCH_ALLOC, BATCH_FREE } type; /* type of request */
     int index;                        /* index for free() to use later */
     size_t size;                      /* byte size of alloc/realloc request */
+    size_t align;                     /* alignment of a memalign request */
+    int count;                        /* ids index.. of a batch request */
 } traceop_t;
 
 /* Holds the information for one trace file*/
@@ -80,6 +89,8 @@ typedef struct {
     char **blocks;       /* array of ptrs returned by malloc/realloc... */
     size_t *block_sizes; /* ... and a corresponding array of payload sizes */
     int *block_rand_base;/* index into random_data, if debug is on */
+    int max_batch;       /* most blocks in one batch request ... */
+    void **batch;        /* ... and room for their pointers */
 } trace_t;
 
 /*
@@ -105,10 +116,34 @@ typedef struct {
 
     /* defined only for the student malloc package */
     double util;     /* space utilization for this trace (always 0 for libc) */
+    unsigned long tc_hits;   /* tcache hits and misses of the validity run */
+    unsigned long tc_misses;
+    double peak;     /* most bytes of heap + mapped regions in the util run */
+    double final;    /* ... and how many were left at its end */
+    double rss;      /* ... and how many of those were resident */
+    unsigned long sbrk_calls; /* mem_sbrk calls that grew the heap ... */
+    double sbrk_secs;         /* ... and the seconds they took, in the util run */
+    mm_stats_t heap;          /* mm_get_stats at the end of the util run */
+    int profiled;             /* prof holds the last timed run (MM_PROFILE) */
+    mm_profile_t prof;
 
     /* Note: secs and util are only defined if valid is true */
 } stats_t;
 
+#ifdef MM_THREADS
+/* One thread of a concurrent replay (-T): the trace's requests are run
+   against private block arrays, so threads only share the allocator */
+typedef struct {
+    trace_t *trace;
+    int id;
+    char **blocks;
+    size_t *block_sizes;
+    void **batch;    /* pointers of a batch request */
+    int failed;      /* 1 + opnum of the first bad block, 0 if none */
+    int oom;         /* stopped because the heap ran out */
+} replay_t;
+#endif
+
 /* Summarizes the key statistics for a set of traces */
 typedef struct {
     double util;  /* average utilization expressed as a percentage */
@@ -154,6 +189,33 @@ static char *default_tracefiles[] = {
 
 char autoresult[MAXLINE]; /* autoresult string */
 
+/* Allocator options given with -o name=value; an option with several
+   comma-separated values is the variant axis, and the traces are run
+   once per value so the results can be compared side by side */
+static char *opt_names[MAXOPTS];
+static char *opt_values[MAXOPTS];
+static int num_opts = 0;
+static int variant_opt = -1;            /* index of the variant option */
+static char *variant_values[MAXVARIANTS];
+static int num_variants = 1;
+
+/* Free blocks with mm_free_sized and their request size (-S) */
+static int sized_free = 0;
+#define MM_FREE(p, size) (sized_free ? mm_free_sized((p), (size)) : mm_free(p))
+
+/* Rounds of the constant-size microbenchmark (-C), 0: no benchmark */
+static int const_rounds = 0;
+#define CONST_BATCH   64 /* blocks of each size per round */
+
+/* Where the util run's allocator events go (-E, MM_EVENTS builds) */
+static FILE *event_file = NULL;
+#define EVENT_FLUSH 8192 /* ops between flushes, well below MM_EV_RING */
+
+#ifdef MM_THREADS
+/* Number of threads replaying each trace at once (-T), 0: no replay */
+static int num_threads = 0;
+#endif
+
 /* Summary statistics for libc and student's mm.c submissions */
 sum_stats_t global_libc_sum_stats;
 sum_stats_t global_mm_sum_stats;
@@ -163,7 +225,7 @@ sum_stats_t global_mm_sum_stats;
  *********************/
 
 /* these functions manipulate range lists */
-static int add_range(range_t **ranges, char *lo, int size,
+static int add_range(range_t **ranges, char *lo, size_t size,
                      const trace_t *trace, int opnum, int index);
 static void remove_range(range_t **ranges, char *lo);
 static void clear_ranges(range_t **ranges);
@@ -187,10 +249,30 @@ static void eval_libc_speed(void *ptr);
    of the student's malloc package in mm.c */
 static int eval_mm_valid(trace_t *trace, range_t **ranges);
 static double eval_mm_util(trace_t *trace, int tracenum);
+static void flush_events(void);
 static void eval_mm_speed(void *ptr);
+#ifdef MM_THREADS
+static void *replay_trace(void *ptr);
+static int replay_check(replay_t *r, int index);
+static void replay_fill(replay_t *r, int index, char *p, size_t size);
+static double eval_mm_threads(trace_t *trace, int nthreads, int *ok);
+static void run_thread_tests(int num_tracefiles, const char *tracedir,
+                             char **tracefiles);
+#endif
+static double eval_const_speed(int rounds, int literal);
+static void run_const_bench(int rounds);
 
 /* Various helper routines */
 static void printresults(int n, stats_t *stats, sum_stats_t *sumstats);
+static void printcompare(int n, stats_t **stats);
+static void printtcache(int n, stats_t *stats);
+static void printheap(int n, stats_t *stats);
+static void printstats(int n, stats_t *stats);
+static void printprofile(int n, stats_t *stats);
+static unsigned long hist_pct(const unsigned long *hist, unsigned long total,
+                              double pct);
+static void printgrowth(int n, stats_t **stats, int nv);
+static void parse_option(char *arg);
 static void usage(void);
 static void malloc_error(const trace_t *trace, int opnum, const char *fmt, ...)
     __attribute__((format(printf, 3,4)));
@@ -236,6 +318,10 @@ static void run_tests(int num_tracefiles, const char *tracedir,
             if (verbose > 1)
                 printf("Checking mm_malloc for correctness, ");
             mm_stats[i].valid = eval_mm_valid(trace, &ranges);
+            mm_tcache_stats(&mm_stats[i].tc_hits, &mm_stats[i].tc_misses);
+            if (verbose > 1 && mm_stats[i].tc_hits + mm_stats[i].tc_misses)
+                printf("tcache %lu hits %lu misses, ",
+                       mm_stats[i].tc_hits, mm_stats[i].tc_misses);
 
             if (onetime_flag) {
                 free_trace(trace);
@@ -246,11 +332,18 @@ static void run_tests(int num_tracefiles, const char *tracedir,
             if (verbose > 1)
                 printf("efficiency, ");
             mm_stats[i].util = eval_mm_util(trace, i);
+            mm_stats[i].peak = mem_peaksize();
+            mm_stats[i].final = mem_heapsize() + mem_mapsize();
+            mm_stats[i].rss = mem_resident();
+            mem_sbrk_stats(&mm_stats[i].sbrk_calls, &mm_stats[i].sbrk_secs);
+            mm_get_stats(&mm_stats[i].heap);
             speed_params->trace = trace;
             speed_params->ranges = ranges;
             if (verbose > 1)
                 printf("and performance.\n");
             mm_stats[i].secs = fsecs(eval_mm_speed, speed_params);
+            mm_stats[i].profiled =
+                mm_get_profile(&mm_stats[i].prof) == 0;
         }
 
         free_trace(trace);
@@ -273,6 +366,9 @@ int main(int argc, char **argv)
     range_t *ranges = NULL;    /* keeps track of block extents for one trace */
     stats_t *libc_stats = NULL;/* libc stats for each trace */
     stats_t *mm_stats = NULL;  /* mm (i.e. student) stats for each trace */
+    stats_t *variant_stats[MAXVARIANTS] = { NULL }; /* mm stats per -o variant */
+    sum_stats_t variant_sum;   /* summary of a variant after the first */
+    int v;
     speed_t speed_params;      /* input parameters to the xx_speed routines */
 
     int run_libc = 0;     /* If set, run libc malloc (set by -l) */
@@ -291,7 +387,7 @@ int main(int argc, char **argv)
     /*
      * Read and interpret the command line arguments
      */
-    while ((c = getopt(argc, argv, "d:f:c:s:t:v:hpVAlD")) != EOF) {
+    while ((c = getopt(argc, argv, "d:f:c:o:s:t:v:C:E:T:H:hpVAlDS")) != EOF) {
         switch (c) {
 
         case 'A': /* Hidden Autolab driver argument */
@@ -352,6 +448,54 @@ int main(int argc, char **argv)
             set_timeout = atoi(optarg);
             break;
 
+        case 'S': /* Free with mm_free_sized */
+            sized_free = 1;
+            break;
+
+        case 'C': /* Run the constant-size microbenchmark only */
+            const_rounds = atoi(optarg);
+            if (const_rounds < 1)
+                app_error("-C takes a positive number of rounds\n");
+            break;
+
+        case 'E': /* Write the allocator events of the util run */
+            if ((event_file = fopen(optarg, "wb")) == NULL)
+                unix_error("Could not open event file");
+            break;
+
+        case 'o': /* Allocator option name=value[,value...] */
+            parse_option(optarg);
+            break;
+
+        case 'T': /* Replay each trace in this many threads at once */
+#ifdef MM_THREADS
+            num_threads = atoi(optarg);
+            if (num_threads < 1 || num_threads > MAXTHREADS)
+                app_error("-T takes 1 to %d threads\n", MAXTHREADS);
+            break;
+#else
+            app_error("-T needs an mm built with MMFLAGS=-DMM_THREADS\n");
+#endif
+
+        case 'H': /* Heap size to reserve, with an optional K/M/G suffix */
+#ifdef MM_LARGE
+        {
+            char *end;
+            size_t bytes = strtoull(optarg, &end, 10);
+            switch (*end) {
+            case 'G': bytes <<= 10; /* fall through */
+            case 'M': bytes <<= 10; /* fall through */
+            case 'K': bytes <<= 10; end++; break;
+            }
+            if (*end != '\0' || bytes == 0)
+                app_error("-H takes a size such as 64G\n");
+            mem_set_maxsize(bytes);
+            break;
+        }
+#else
+            app_error("-H needs an mm built with MMFLAGS=-DMM_LARGE\n");
+#endif
+
         case 'h': /* Print this message */
             usage();
             exit(0);
@@ -372,6 +516,22 @@ int main(int argc, char **argv)
         init_random_data();
     }
 
+    /* Hand the fixed allocator options to the mm package */
+    for (i = 0; i < num_opts; i++) {
+        if (i == variant_opt)
+            continue;
+        if (mm_setopt(opt_names[i], opt_values[i]) < 0)
+            app_error("Unknown allocator option %s=%s\n",
+                      opt_names[i], opt_values[i]);
+    }
+    if (onetime_flag)
+        num_variants = 1;
+
+    if (const_rounds > 0) {
+        run_const_bench(const_rounds);
+        exit(0);
+    }
+
     /* Initialize the timing package */
     init_fsecs();
 
@@ -423,30 +583,62 @@ int main(int argc, char **argv)
     if (verbose > 1)
         printf("\nTesting mm malloc\n");
 
-    /* Allocate the mm stats array, with one stats_t struct per tracefile */
-    mm_stats = (stats_t *)calloc(num_tracefiles, sizeof(stats_t));
-    if (mm_stats == NULL)
-        unix_error("mm_stats calloc in main failed");
+    /* Run the traces once per variant; the first one is graded */
+    for (v = 0; v < num_variants; v++) {
+        /* Allocate the mm stats array, with one stats_t struct per tracefile */
+        mm_stats = (stats_t *)calloc(num_tracefiles, sizeof(stats_t));
+        if (mm_stats == NULL)
+            unix_error("mm_stats calloc in main failed");
+        variant_stats[v] = mm_stats;
+
+        if (variant_opt >= 0 &&
+            mm_setopt(opt_names[variant_opt], variant_values[v]) < 0)
+            app_error("Unknown allocator option %s=%s\n",
+                      opt_names[variant_opt], variant_values[v]);
 
-    run_tests(num_tracefiles, tracedir, tracefiles, mm_stats,
-              ranges, &speed_params);
+        run_tests(num_tracefiles, tracedir, tracefiles, mm_stats,
+                  ranges, &speed_params);
 
 
-    /* Display the mm results in a compact table */
-    if (verbose) {
-        if (onetime_flag) {
-            printf("\n\ncorrectness check finished, by running tracefile \"%s\".\n", tracefiles[num_tracefiles-1]);
-            if (mm_stats[num_tracefiles-1].valid) {
-                printf(" => correct.\n\n");
+        /* Display the mm results in a compact table */
+        if (verbose) {
+            if (onetime_flag) {
+                printf("\n\ncorrectness check finished, by running tracefile \"%s\".\n", tracefiles[num_tracefiles-1]);
+                if (mm_stats[num_tracefiles-1].valid) {
+                    printf(" => correct.\n\n");
+                } else {
+                    printf(" => incorrect.\n\n");
+                }
             } else {
-                printf(" => incorrect.\n\n");
+                if (variant_opt >= 0)
+                    printf("\nResults for mm malloc (%s=%s):\n",
+                           opt_names[variant_opt], variant_values[v]);
+                else
+                    printf("\nResults for mm malloc:\n");
+                printresults(num_tracefiles, mm_stats,
+                             v == 0 ? &global_mm_sum_stats : &variant_sum);
+                printtcache(num_tracefiles, mm_stats);
+                printheap(num_tracefiles, mm_stats);
+                printstats(num_tracefiles, mm_stats);
+                printprofile(num_tracefiles, mm_stats);
+                if (verbose > 1)
+                    printgrowth(num_tracefiles, &mm_stats, 1);
+                printf("\n");
             }
-        } else {
-            printf("\nResults for mm malloc:\n");
-            printresults(num_tracefiles, mm_stats, &global_mm_sum_stats);
-            printf("\n");
         }
     }
+    /* The rest (threads, -l, the grade) is about the first variant */
+    mm_stats = variant_stats[0];
+    if (num_variants > 1)
+        mm_setopt(opt_names[variant_opt], variant_values[0]);
+
+    if (num_variants > 1)
+        printcompare(num_tracefiles, variant_stats);
+
+#ifdef MM_THREADS
+    if (num_threads > 0 && !onetime_flag)
+        run_thread_tests(num_tracefiles, tracedir, tracefiles);
+#endif
 
     /* Optionally compare the performance of mm and libc */
     if (run_libc) {
@@ -591,10 +783,11 @@ int main(int argc, char **argv)
  *     size bytes at addr lo. After checking the block for correctness,
  *     we create a range struct for this block and add it to the range list.
  */
-static int add_range(range_t **ranges, char *lo, int size,
+static int add_range(range_t **ranges, char *lo, size_t size,
                      const trace_t *trace, int opnum, int index)
 {
     char *hi = lo + size - 1;
+    size_t usable;
     range_t *p;
 
     assert(size > 0);
@@ -606,15 +799,28 @@ static int add_range(range_t **ranges, char *lo, int size,
         return 0;
     }
 
-    /* The payload must lie within the extent of the heap */
-    if ((lo < (char *)mem_heap_lo()) || (lo > (char *)mem_heap_hi()) ||
-        (hi < (char *)mem_heap_lo()) || (hi > (char *)mem_heap_hi())) {
+    /* The payload must lie within the extent of the heap, or of one
+       region mapped with mem_map */
+    if (((lo < (char *)mem_heap_lo()) || (lo > (char *)mem_heap_hi()) ||
+         (hi < (char *)mem_heap_lo()) || (hi > (char *)mem_heap_hi())) &&
+        !mem_mapped(lo, hi)) {
         malloc_error(trace, opnum,
                      "Payload (%p:%p) lies outside heap (%p:%p)",
                      lo, hi, mem_heap_lo(), mem_heap_hi());
         return 0;
     }
 
+    /* So must the slack that mm_malloc_usable_size reports */
+    usable = mm_malloc_usable_size(lo);
+    if (usable < size ||
+        (((lo + usable - 1 > (char *)mem_heap_hi()) || (lo < (char *)mem_heap_lo())) &&
+         !mem_mapped(lo, lo + usable - 1))) {
+        malloc_error(trace, opnum,
+                     "Payload (%p) of %zu bytes has %zu usable bytes",
+                     lo, size, usable);
+        return 0;
+    }
+
     /* If we can't afford the linear-time loop, we check less thoroughly and
        just assume the overlap will be caught by writing random bits. */
     if(trace->ignore_ranges || debug_mode == DBG_NONE) return 1;
@@ -754,7 +960,9 @@ static trace_t *read_trace(stats_t *stats, const char *tracedir,
     FILE *tracefile;
     trace_t *trace;
     char type[MAXLINE];
-    int index, size;
+    int index;
+    size_t size, align;
+    int count;
     int max_index = 0;
     int op_index;
 
@@ -807,22 +1015,51 @@ static trace_t *read_trace(stats_t *stats, const char *tracedir,
     /* read every request line in the trace file */
     index = 0;
     op_index = 0;
+    trace->max_batch = 1;
     while (fscanf(tracefile, "%s", type) != EOF) {
         switch(type[0]) {
         case 'a':
-            fscanf(tracefile, "%u %u", &index, &size);
+            fscanf(tracefile, "%d %zu", &index, &size);
             trace->ops[op_index].type = ALLOC;
             trace->ops[op_index].index = index;
             trace->ops[op_index].size = size;
             max_index = (index > max_index) ? index : max_index;
             break;
         case 'r':
-            fscanf(tracefile, "%u %u", &index, &size);
+            fscanf(tracefile, "%d %zu", &index, &size);
             trace->ops[op_index].type = REALLOC;
             trace->ops[op_index].index = index;
             trace->ops[op_index].size = size;
             max_index = (index > max_index) ? index : max_index;
             break;
+        case 'm': /* m <id> <size> <alignment> */
+            fscanf(tracefile, "%d %zu %zu", &index, &size, &align);
+            if (align == 0 || (align & (align - 1)) || align % sizeof(void *))
+                app_error("%s: bad alignment %zu", trace->filename, align);
+            trace->ops[op_index].type = MEMALIGN;
+            trace->ops[op_index].index = index;
+            trace->ops[op_index].size = size;
+            trace->ops[op_index].align = align;
+            max_index = (index > max_index) ? index : max_index;
+            break;
+        case 'b': /* b <first id> <count> <size> */
+        case 'B': /* B <first id> <count> */
+            fscanf(tracefile, "%d %d", &index, &count);
+            if (count < 1)
+                app_error("%s: bad batch count %d", trace->filename, count);
+            if (type[0] == 'b') {
+                fscanf(tracefile, "%zu", &size);
+                trace->ops[op_index].type = BATCH_ALLOC;
+                trace->ops[op_index].size = size;
+            } else
+                trace->ops[op_index].type = BATCH_FREE;
+            trace->ops[op_index].index = index;
+            trace->ops[op_index].count = count;
+            max_index = (index + count - 1 > max_index) ?
+                index + count - 1 : max_index;
+            trace->max_batch = (count > trace->max_batch) ?
+                count : trace->max_batch;
+            break;
         case 'f':
             fscanf(tracefile, "%ud", &index);
             trace->ops[op_index].type = FREE;
@@ -837,6 +1074,9 @@ static trace_t *read_trace(stats_t *stats, const char *tracedir,
     }
     fclose(tracefile);
     assert(max_index == trace->num_ids - 1);
+
+    if ((trace->batch = malloc(trace->max_batch * sizeof(void *))) == NULL)
+        unix_error("malloc 6 failed in read_trace");
     assert(trace->num_ops == op_index);
 
     /* fill in the stats */
@@ -858,7 +1098,7 @@ static void reinit_trace(trace_t *trace)
 }
 
 /*
- * free_trace - Free the trace record and the four arrays it points
+ * free_trace - Free the trace record and the five arrays it points
  *              to, all of which were allocated in read_trace().
  */
 static void free_trace(trace_t *trace)
@@ -867,6 +1107,7 @@ static void free_trace(trace_t *trace)
     free(trace->blocks);
     free(trace->block_sizes);
     free(trace->block_rand_base);
+    free(trace->batch);
     free(trace);              /* and the trace record itself... */
 }
 
@@ -880,7 +1121,7 @@ static void free_trace(trace_t *trace)
  */
 static int eval_mm_valid(trace_t *trace, range_t **ranges)
 {
-    int i;
+    int i, k, n;
     int index;
     size_t size;
     char *newp;
@@ -920,11 +1161,24 @@ static int eval_mm_valid(trace_t *trace, range_t **ranges)
         switch (trace->ops[i].type) {
 
         case ALLOC: /* mm_malloc */
+        case MEMALIGN: /* mm_memalign */
 
             /* Call the student's malloc */
-            if ((p = mm_malloc(size)) == NULL) {
-                malloc_error(trace, i, "mm_malloc failed.");
-                return 0;
+            if (trace->ops[i].type == ALLOC) {
+                if ((p = mm_malloc(size)) == NULL) {
+                    malloc_error(trace, i, "mm_malloc failed.");
+                    return 0;
+                }
+            } else {
+                if ((p = mm_memalign(trace->ops[i].align, size)) == NULL) {
+                    malloc_error(trace, i, "mm_memalign failed.");
+                    return 0;
+                }
+                if ((unsigned long)p % trace->ops[i].align) {
+                    malloc_error(trace, i, "Payload address (%p) not aligned "
+                                 "to %zu bytes", p, trace->ops[i].align);
+                    return 0;
+                }
             }
 
             /*
@@ -989,11 +1243,39 @@ static int eval_mm_valid(trace_t *trace, range_t **ranges)
             /* Remove region from list and call student's free function */
             if(index == -1) {
                 p = 0;
+                size = 0;
             } else {
                 p = trace->blocks[index];
+                size = trace->block_sizes[index];
                 remove_range(ranges, p);
             }
-            mm_free(p);
+            MM_FREE(p, size);
+            break;
+
+        case BATCH_ALLOC: /* mm_malloc_batch */
+            n = trace->ops[i].count;
+            if (mm_malloc_batch(size, n, trace->batch) != (size_t)n) {
+                malloc_error(trace, i, "mm_malloc_batch failed.");
+                return 0;
+            }
+            for (k = 0; k < n; k++) {
+                p = trace->batch[k];
+                if (add_range(ranges, p, size, trace, i, index + k) == 0)
+                    return 0;
+                trace->blocks[index + k] = p;
+                trace->block_sizes[index + k] = size;
+                randomize_block(trace, index + k);
+            }
+            break;
+
+        case BATCH_FREE: /* mm_free_batch */
+            n = trace->ops[i].count;
+            for (k = 0; k < n; k++) {
+                check_index(trace, i, index + k);
+                trace->batch[k] = trace->blocks[index + k];
+                remove_range(ranges, trace->batch[k]);
+            }
+            mm_free_batch(trace->batch, n);
             break;
 
         default:
@@ -1010,21 +1292,21 @@ static int eval_mm_valid(trace_t *trace, range_t **ranges)
  * eval_mm_util - Evaluate the space utilization of the student's package
  *   The idea is to remember the high water mark "hwm" of the heap for
  *   an optimal allocator, i.e., no gaps and no internal fragmentation.
- *   Utilization is the ratio hwm/heapsize, where heapsize is the
- *   size of the heap in bytes after running the student's malloc
- *   package on the trace. Note that our implementation of mem_sbrk()
- *   doesn't allow the students to decrement the brk pointer, so brk
- *   is always the high water mark of the heap.
+ *   Utilization is the ratio hwm/heapsize, where heapsize is
+ *   mem_peaksize(): the most bytes the heap and the regions from
+ *   mem_map held together while running the student's malloc package
+ *   on the trace. mem_sbrk() accepts negative increments, so the heap
+ *   may end smaller than that peak.
  *
  *   A higher number is better: 1 is optimal.
  */
 static double eval_mm_util(trace_t *trace, int tracenum)
 {
-    int i;
+    int i, k, n;
     int index;
-    int size, newsize, oldsize;
-    int max_total_size = 0;
-    int total_size = 0;
+    size_t size, newsize, oldsize;
+    size_t max_total_size = 0;
+    size_t total_size = 0;
     char *p;
     char *newp, *oldp;
 
@@ -1039,10 +1321,13 @@ static double eval_mm_util(trace_t *trace, int tracenum)
         switch (trace->ops[i].type) {
 
         case ALLOC: /* mm_alloc */
+        case MEMALIGN: /* mm_memalign */
             index = trace->ops[i].index;
             size = trace->ops[i].size;
 
-            if ((p = mm_malloc(size)) == NULL) {
+            p = (trace->ops[i].type == ALLOC) ? mm_malloc(size) :
+                mm_memalign(trace->ops[i].align, size);
+            if (p == NULL) {
                 app_error("trace %d: mm_malloc failed in eval_mm_util",
                           tracenum);
             }
@@ -1069,7 +1354,7 @@ static double eval_mm_util(trace_t *trace, int tracenum)
             trace->blocks[index] = newp;
             trace->block_sizes[index] = newsize;
 
-            total_size += (newsize - oldsize);
+            total_size = total_size - oldsize + newsize;
             break;
 
         case FREE: /* mm_free */
@@ -1082,24 +1367,65 @@ static double eval_mm_util(trace_t *trace, int tracenum)
                 p = trace->blocks[index];
             }
 
-            mm_free(p);
+            MM_FREE(p, size);
 
             total_size -= size;
             break;
 
+        case BATCH_ALLOC: /* mm_malloc_batch */
+            index = trace->ops[i].index;
+            size = trace->ops[i].size;
+            n = trace->ops[i].count;
+            if (mm_malloc_batch(size, n, trace->batch) != (size_t)n) {
+                app_error("trace %d: mm_malloc_batch failed in eval_mm_util",
+                          tracenum);
+            }
+            for (k = 0; k < n; k++) {
+                trace->blocks[index + k] = trace->batch[k];
+                trace->block_sizes[index + k] = size;
+            }
+            total_size += size * n;
+            break;
+
+        case BATCH_FREE: /* mm_free_batch */
+            index = trace->ops[i].index;
+            n = trace->ops[i].count;
+            for (k = 0; k < n; k++) {
+                trace->batch[k] = trace->blocks[index + k];
+                total_size -= trace->block_sizes[index + k];
+            }
+            mm_free_batch(trace->batch, n);
+            break;
+
         default:
             app_error("trace %d: Nonexistent request type in eval_mm_util",
                       tracenum);
         }
 
+        if (event_file && (i + 1) % EVENT_FLUSH == 0)
+            flush_events();
+
         /* update the high-water mark */
         max_total_size = (total_size > max_total_size) ?
             total_size : max_total_size;
     }
 
+    if (event_file)
+        flush_events();
     printf(".");
 
-    return ((double)max_total_size / (double)mem_heapsize());
+    /* Mapped regions count as heap while they exist */
+    return ((double)max_total_size / (double)mem_peaksize());
+}
+
+/*
+ * flush_events - Append the allocator events recorded so far to the
+ *     -E file; mmevents turns the file into a Chrome trace
+ */
+static void flush_events(void)
+{
+    if (mm_flush_events(event_file) < 0)
+        app_error("-E needs an mm built with MMFLAGS=-DMM_EVENTS\n");
 }
 
 
@@ -1109,7 +1435,8 @@ static double eval_mm_util(trace_t *trace, int tracenum)
  */
 static void eval_mm_speed(void *ptr)
 {
-    int i, index, size, newsize;
+    int i, k, n, index;
+    size_t size, newsize;
     char *p, *newp, *oldp, *block;
     trace_t *trace = ((speed_t *)ptr)->trace;
     reinit_trace(trace);
@@ -1129,6 +1456,16 @@ static void eval_mm_speed(void *ptr)
             if ((p = mm_malloc(size)) == NULL)
                 app_error("mm_malloc error in eval_mm_speed");
             trace->blocks[index] = p;
+            trace->block_sizes[index] = size;
+            break;
+
+        case MEMALIGN: /* mm_memalign */
+            index = trace->ops[i].index;
+            size = trace->ops[i].size;
+            if ((p = mm_memalign(trace->ops[i].align, size)) == NULL)
+                app_error("mm_memalign error in eval_mm_speed");
+            trace->blocks[index] = p;
+            trace->block_sizes[index] = size;
             break;
 
         case REALLOC: /* mm_realloc */
@@ -1138,16 +1475,39 @@ static void eval_mm_speed(void *ptr)
             if ((newp = mm_realloc(oldp,newsize)) == NULL && newsize != 0)
                 app_error("mm_realloc error in eval_mm_speed");
             trace->blocks[index] = newp;
+            trace->block_sizes[index] = newsize;
             break;
 
         case FREE: /* mm_free */
             index = trace->ops[i].index;
             if(index < 0) {
                 block = 0;
+                size = 0;
             } else {
                 block = trace->blocks[index];
+                size = trace->block_sizes[index];
+            }
+            MM_FREE(block, size);
+            break;
+
+        case BATCH_ALLOC: /* mm_malloc_batch */
+            index = trace->ops[i].index;
+            size = trace->ops[i].size;
+            n = trace->ops[i].count;
+            if (mm_malloc_batch(size, n, trace->batch) != (size_t)n)
+                app_error("mm_malloc_batch error in eval_mm_speed");
+            for (k = 0; k < n; k++) {
+                trace->blocks[index + k] = trace->batch[k];
+                trace->block_sizes[index + k] = size;
             }
-            mm_free(block);
+            break;
+
+        case BATCH_FREE: /* mm_free_batch */
+            index = trace->ops[i].index;
+            n = trace->ops[i].count;
+            for (k = 0; k < n; k++)
+                trace->batch[k] = trace->blocks[index + k];
+            mm_free_batch(trace->batch, n);
             break;
 
         default:
@@ -1155,6 +1515,278 @@ static void eval_mm_speed(void *ptr)
         }
 }
 
+#ifdef MM_THREADS
+/*
+ * replay_trace - Run one thread's copy of a trace. Every block gets a
+ *     thread- and index-specific byte pattern at both ends, checked
+ *     before it is freed or reallocated, so blocks handed to two
+ *     threads at once or corrupted by another arena show up.
+ */
+static void *replay_trace(void *ptr)
+{
+    replay_t *r = (replay_t *)ptr;
+    trace_t *trace = r->trace;
+    int i, index, k, count;
+    size_t size, oldsize;
+    char *p, *oldp;
+
+    for (i = 0; i < trace->num_ops; i++) {
+        index = trace->ops[i].index;
+        size = trace->ops[i].size;
+        count = trace->ops[i].count;
+        if (!replay_check(r, index)) {
+            r->failed = i + 1;
+            return NULL;
+        }
+        oldp = (index == -1) ? NULL : r->blocks[index];
+        oldsize = oldp ? r->block_sizes[index] : 0;
+
+        switch (trace->ops[i].type) {
+        case ALLOC:
+        case REALLOC:
+        case MEMALIGN:
+            p = (trace->ops[i].type == ALLOC) ? mm_malloc(size) :
+                (trace->ops[i].type == MEMALIGN) ?
+                mm_memalign(trace->ops[i].align, size) :
+                mm_realloc(oldp, size);
+            if (p == NULL && size > 0) {
+                r->oom = 1;
+                return NULL;
+            }
+            replay_fill(r, index, p, size);
+            break;
+
+        case FREE:
+            MM_FREE(oldp, oldsize);
+            if (index != -1)
+                r->blocks[index] = NULL;
+            break;
+
+        case BATCH_ALLOC:
+            if (mm_malloc_batch(size, count, r->batch) != (size_t)count) {
+                r->oom = 1;
+                return NULL;
+            }
+            for (k = 0; k < count; k++)
+                replay_fill(r, index + k, r->batch[k], size);
+            break;
+
+        case BATCH_FREE:
+            for (k = 0; k < count; k++) {
+                if (!replay_check(r, index + k)) {
+                    r->failed = i + 1;
+                    return NULL;
+                }
+                r->batch[k] = r->blocks[index + k];
+                r->blocks[index + k] = NULL;
+            }
+            mm_free_batch(r->batch, count);
+            break;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * replay_check - Does block index of a replay (if any) still hold the
+ *     pattern that replay_fill wrote?
+ */
+static int replay_check(replay_t *r, int index)
+{
+    char *p = (index == -1) ? NULL : r->blocks[index];
+    size_t size = p ? r->block_sizes[index] : 0;
+    size_t k, n = size < 8 ? size : 8;
+
+    for (k = 0; k < n; k++)
+        if (p[k] != (char)(r->id + index + k) ||
+            p[size - 1 - k] != (char)(r->id + index + size - 1 - k))
+            return 0;
+    return 1;
+}
+
+/*
+ * replay_fill - Record p as block index of a replay and write the
+ *     pattern at both of its ends
+ */
+static void replay_fill(replay_t *r, int index, char *p, size_t size)
+{
+    size_t k, n = size < 8 ? size : 8;
+
+    for (k = 0; k < n; k++) {
+        p[k] = (char)(r->id + index + k);
+        p[size - 1 - k] = (char)(r->id + index + size - 1 - k);
+    }
+    r->blocks[index] = p;
+    r->block_sizes[index] = size;
+}
+
+/*
+ * eval_mm_threads - Replay trace in nthreads threads at once on a fresh
+ *     heap; return the wall-clock seconds taken and set *ok to 1 if all
+ *     went well, 0 if the heap ran out and -1 on corrupted blocks
+ */
+static double eval_mm_threads(trace_t *trace, int nthreads, int *ok)
+{
+    pthread_t tids[MAXTHREADS];
+    replay_t r[MAXTHREADS];
+    struct timespec start, end;
+    int t;
+
+    mem_reset_brk();
+    if (mm_init() < 0)
+        app_error("mm_init failed in eval_mm_threads");
+
+    for (t = 0; t < nthreads; t++) {
+        r[t].trace = trace;
+        r[t].id = t * 31;
+        r[t].failed = 0;
+        r[t].oom = 0;
+        r[t].blocks = calloc(trace->num_ids, sizeof(char *));
+        r[t].block_sizes = calloc(trace->num_ids, sizeof(size_t));
+        r[t].batch = malloc(trace->max_batch * sizeof(void *));
+        if (r[t].blocks == NULL || r[t].block_sizes == NULL || r[t].batch == NULL)
+            unix_error("calloc in eval_mm_threads failed");
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (t = 0; t < nthreads; t++)
+        if (pthread_create(&tids[t], NULL, replay_trace, &r[t]) != 0)
+            unix_error("pthread_create in eval_mm_threads failed");
+    for (t = 0; t < nthreads; t++)
+        pthread_join(tids[t], NULL);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    *ok = 1;
+    for (t = 0; t < nthreads; t++) {
+        if (r[t].failed) {
+            malloc_error(trace, r[t].failed - 1,
+                         "thread %d: block lost its contents", t);
+            *ok = -1;
+        } else if (r[t].oom && *ok > 0)
+            *ok = 0;
+        free(r[t].blocks);
+        free(r[t].block_sizes);
+        free(r[t].batch);
+    }
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+/*
+ * run_thread_tests - Replay every trace in 1 and in num_threads threads
+ *     and print the throughput of both
+ */
+static void run_thread_tests(int num_tracefiles, const char *tracedir,
+                             char **tracefiles)
+{
+    stats_t stats;
+    trace_t *trace;
+    double secs1, secsn, ops1 = 0, opsn = 0, tot1 = 0, totn = 0;
+    int i, ok1, okn;
+
+    printf("Results for mm malloc with %d threads:\n", num_threads);
+    printf("%5s %8s %10s %10s %8s  %s\n",
+           "valid", "ops", "Kops(1)", "Kops(T)", "speedup", "trace");
+    for (i = 0; i < num_tracefiles; i++) {
+        mem_init();
+        trace = read_trace(&stats, tracedir, tracefiles[i]);
+        secs1 = eval_mm_threads(trace, 1, &ok1);
+        secsn = eval_mm_threads(trace, num_threads, &okn);
+        if (ok1 > 0 && okn > 0 && secs1 > 0 && secsn > 0) {
+            printf("%5s %8d %10.0f %10.0f %8.2f  %s\n", "yes",
+                   trace->num_ops * num_threads,
+                   trace->num_ops / secs1 / 1e3,
+                   trace->num_ops * num_threads / secsn / 1e3,
+                   trace->num_ops * num_threads / secsn /
+                   (trace->num_ops / secs1), trace->filename);
+            ops1 += trace->num_ops;
+            tot1 += secs1;
+            opsn += (double)trace->num_ops * num_threads;
+            totn += secsn;
+        } else {
+            printf("%5s %8s %10s %10s %8s  %s\n",
+                   (ok1 < 0 || okn < 0) ? "no" : "oom",
+                   "-", "-", "-", "-", trace->filename);
+        }
+        free_trace(trace);
+        mem_deinit();
+    }
+    if (tot1 > 0 && totn > 0)
+        printf("%5s %8.0f %10.0f %10.0f %8.2f\n\n", "Total", opsn,
+               ops1 / tot1 / 1e3, opsn / totn / 1e3,
+               (opsn / totn) / (ops1 / tot1));
+}
+#endif
+
+/*
+ * eval_const_speed - Allocate CONST_BATCH blocks each of 16, 24, 40 and
+ *     100 bytes and free them again, rounds times. With literal set the
+ *     sizes are constants, so mm.h folds them and calls mm_malloc_fixed;
+ *     otherwise the same sizes come from a volatile array and take the
+ *     generic mm_malloc. Returns the seconds taken.
+ */
+static double eval_const_speed(int rounds, int literal)
+{
+    static volatile size_t sizes[4] = { 16, 24, 40, 100 };
+    void *p[4 * CONST_BATCH];
+    struct timespec start, end;
+    int r, j;
+
+    mem_reset_brk();
+    if (mm_init() < 0)
+        app_error("mm_init failed in eval_const_speed");
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (r = 0; r < rounds; r++) {
+        if (literal) {
+            for (j = 0; j < 4 * CONST_BATCH; j += 4) {
+                p[j] = mm_malloc(16);
+                p[j + 1] = mm_malloc(24);
+                p[j + 2] = mm_malloc(40);
+                p[j + 3] = mm_malloc(100);
+            }
+        } else {
+            for (j = 0; j < 4 * CONST_BATCH; j += 4) {
+                p[j] = mm_malloc(sizes[0]);
+                p[j + 1] = mm_malloc(sizes[1]);
+                p[j + 2] = mm_malloc(sizes[2]);
+                p[j + 3] = mm_malloc(sizes[3]);
+            }
+        }
+        for (j = 0; j < 4 * CONST_BATCH; j++) {
+            if (p[j] == NULL)
+                app_error("mm_malloc failed in eval_const_speed");
+            mm_free(p[j]);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+/*
+ * run_const_bench - Time constant and run-time sizes alternately, three
+ *     times each, and print the best ns per malloc/free pair of both
+ */
+static void run_const_bench(int rounds)
+{
+    double best[2] = { DBL_MAX, DBL_MAX }, secs;
+    double pairs = (double)rounds * 4 * CONST_BATCH;
+    int i, literal;
+
+    mem_init();
+    for (i = 0; i < 3; i++) {
+        for (literal = 1; literal >= 0; literal--) {
+            secs = eval_const_speed(rounds, literal);
+            if (secs < best[literal])
+                best[literal] = secs;
+        }
+    }
+    printf("Constant-size microbenchmark (%d rounds of %d blocks):\n",
+           rounds, 4 * CONST_BATCH);
+    printf("%-10s%10s\n", "sizes", "ns/pair");
+    printf("%-10s%10.1f\n", "constant", best[1] * 1e9 / pairs);
+    printf("%-10s%10.1f\n", "run-time", best[0] * 1e9 / pairs);
+}
+
 /*
  * eval_libc_valid - We run this function to make sure that the
  *    libc malloc can run to completion on the set of traces.
@@ -1163,7 +1795,8 @@ static void eval_mm_speed(void *ptr)
  */
 static int eval_libc_valid(trace_t *trace)
 {
-    int i, newsize;
+    int i, k;
+    size_t newsize;
     char *p, *newp, *oldp;
 
     reinit_trace(trace);
@@ -1179,6 +1812,15 @@ static int eval_libc_valid(trace_t *trace)
             trace->blocks[trace->ops[i].index] = p;
             break;
 
+        case MEMALIGN: /* posix_memalign */
+            if (posix_memalign((void **)&p, trace->ops[i].align,
+                               trace->ops[i].size) != 0) {
+                malloc_error(trace, i, "libc posix_memalign failed");
+                unix_error("System message");
+            }
+            trace->blocks[trace->ops[i].index] = p;
+            break;
+
         case REALLOC: /* realloc */
             newsize = trace->ops[i].size;
             oldp = trace->blocks[trace->ops[i].index];
@@ -1197,6 +1839,21 @@ static int eval_libc_valid(trace_t *trace)
             }
             break;
 
+        case BATCH_ALLOC: /* malloc, count times */
+            for (k = 0; k < trace->ops[i].count; k++) {
+                if ((p = malloc(trace->ops[i].size)) == NULL) {
+                    malloc_error(trace, i, "libc malloc failed");
+                    unix_error("System message");
+                }
+                trace->blocks[trace->ops[i].index + k] = p;
+            }
+            break;
+
+        case BATCH_FREE: /* free, count times */
+            for (k = 0; k < trace->ops[i].count; k++)
+                free(trace->blocks[trace->ops[i].index + k]);
+            break;
+
         default:
             app_error("invalid operation type  in eval_libc_valid");
         }
@@ -1212,8 +1869,9 @@ static int eval_libc_valid(trace_t *trace)
  */
 static void eval_libc_speed(void *ptr)
 {
-    int i;
-    int index, size, newsize;
+    int i, k;
+    int index;
+    size_t size, newsize;
     char *p, *newp, *oldp, *block;
     trace_t *trace = ((speed_t *)ptr)->trace;
 
@@ -1229,6 +1887,14 @@ static void eval_libc_speed(void *ptr)
             trace->blocks[index] = p;
             break;
 
+        case MEMALIGN: /* posix_memalign */
+            index = trace->ops[i].index;
+            size = trace->ops[i].size;
+            if (posix_memalign((void **)&p, trace->ops[i].align, size) != 0)
+                unix_error("posix_memalign failed in eval_libc_speed");
+            trace->blocks[index] = p;
+            break;
+
         case REALLOC: /* realloc */
             index = trace->ops[i].index;
             newsize = trace->ops[i].size;
@@ -1248,6 +1914,22 @@ static void eval_libc_speed(void *ptr)
                 free(0);
             }
             break;
+
+        case BATCH_ALLOC: /* malloc, count times */
+            index = trace->ops[i].index;
+            size = trace->ops[i].size;
+            for (k = 0; k < trace->ops[i].count; k++) {
+                if ((p = malloc(size)) == NULL)
+                    unix_error("malloc failed in eval_libc_speed");
+                trace->blocks[index + k] = p;
+            }
+            break;
+
+        case BATCH_FREE: /* free, count times */
+            index = trace->ops[i].index;
+            for (k = 0; k < trace->ops[i].count; k++)
+                free(trace->blocks[index + k]);
+            break;
         }
     }
 }
@@ -1383,6 +2065,302 @@ static void printresults(int n, stats_t *stats, sum_stats_t *sumstats)
     }
 }
 
+/*
+ * printcompare - prints util and Kops of every -o variant side by side,
+ *                one row per trace, followed by the weighted averages.
+ */
+static void printcompare(int n, stats_t **stats)
+{
+    int i, v;
+
+    printf("Comparison of %s:\n", opt_names[variant_opt]);
+    printf("%-24s", "");
+    for (v = 0; v < num_variants; v++)
+        printf(" %14s", variant_values[v]);
+    printf("\n%-24s", "trace");
+    for (v = 0; v < num_variants; v++)
+        printf(" %5s %8s", "util", "Kops");
+    printf("\n");
+
+    for (i = 0; i < n; i++) {
+        const char *name = strrchr(stats[0][i].filename, '/');
+        printf("%-24s", name ? name + 1 : stats[0][i].filename);
+        for (v = 0; v < num_variants; v++) {
+            if (stats[v][i].valid)
+                printf(" %4.0f%% %8.0f", stats[v][i].util * 100.0,
+                       (stats[v][i].ops/1e3)/stats[v][i].secs);
+            else
+                printf(" %5s %8s", "-", "-");
+        }
+        printf("\n");
+    }
+
+    /* Same weighting as printresults */
+    printf("%-24s", "average");
+    for (v = 0; v < num_variants; v++) {
+        double sumutil = 0, sumops = 0, sumsecs = 0;
+        int nutil = 0;
+        for (i = 0; i < n; i++) {
+            if (!stats[v][i].valid)
+                continue;
+            if (stats[v][i].weight == WALL || stats[v][i].weight == WPERF) {
+                sumops += stats[v][i].ops;
+                sumsecs += stats[v][i].secs;
+            }
+            if (stats[v][i].weight == WALL || stats[v][i].weight == WUTIL) {
+                sumutil += stats[v][i].util;
+                nutil++;
+            }
+        }
+        printf(" %4.0f%% %8.0f", nutil ? sumutil / nutil * 100.0 : 0.0,
+               sumsecs == 0.0 ? 0.0 : (sumops/1e3)/sumsecs);
+    }
+    printf("\n\n");
+
+    /* Heap extensions of each trace, if any variant changes them */
+    for (i = 0; i < n; i++)
+        for (v = 1; v < num_variants; v++)
+            if (stats[v][i].sbrk_calls != stats[0][i].sbrk_calls) {
+                printgrowth(n, stats, num_variants);
+                i = n;
+                break;
+            }
+
+    /* Resident memory left at the end of each trace, if any variant
+       changes it (e.g. by purging free pages) */
+    for (i = 0; i < n; i++)
+        for (v = 1; v < num_variants; v++)
+            if (stats[v][i].rss != stats[0][i].rss)
+                goto differ;
+    return;
+differ:
+    printf("Resident KB at the end of each trace:\n%-24s", "trace");
+    for (v = 0; v < num_variants; v++)
+        printf(" %14s", variant_values[v]);
+    printf("\n");
+    for (i = 0; i < n; i++) {
+        const char *name = strrchr(stats[0][i].filename, '/');
+        printf("%-24s", name ? name + 1 : stats[0][i].filename);
+        for (v = 0; v < num_variants; v++) {
+            if (stats[v][i].valid)
+                printf(" %14.0f", stats[v][i].rss / 1024);
+            else
+                printf(" %14s", "-");
+        }
+        printf("\n");
+    }
+    printf("\n");
+}
+
+/*
+ * printgrowth - Print the mem_sbrk calls that grew the heap and the time
+ *     spent in them, per trace, for each of nv variants
+ */
+static void printgrowth(int n, stats_t **stats, int nv)
+{
+    int i, v;
+
+    printf("mem_sbrk calls (usecs) in each util run:\n%-24s", "trace");
+    for (v = 0; v < nv; v++)
+        printf(" %16s", nv > 1 ? variant_values[v] : "");
+    printf("\n");
+    for (i = 0; i < n; i++) {
+        const char *name = strrchr(stats[0][i].filename, '/');
+        printf("%-24s", name ? name + 1 : stats[0][i].filename);
+        for (v = 0; v < nv; v++) {
+            if (stats[v][i].valid)
+                printf(" %7lu (%6.0f)", stats[v][i].sbrk_calls,
+                       stats[v][i].sbrk_secs * 1e6);
+            else
+                printf(" %16s", "-");
+        }
+        printf("\n");
+    }
+    printf("\n");
+}
+
+/*
+ * printtcache - Print the tcache hit rate over all traces, if it was on
+ */
+static void printtcache(int n, stats_t *stats)
+{
+    double hits = 0, misses = 0;
+    int i;
+
+    for (i = 0; i < n; i++) {
+        hits += stats[i].tc_hits;
+        misses += stats[i].tc_misses;
+    }
+    if (hits + misses > 0)
+        printf("tcache: %.0f hits, %.0f misses (%.1f%% hit rate)\n",
+               hits, misses, 100.0 * hits / (hits + misses));
+}
+
+/*
+ * printheap - Print the peak, final and resident heap size of every
+ *     trace, if memory was given back on any of them
+ */
+static void printheap(int n, stats_t *stats)
+{
+    double peak = 0, final = 0, rss = 0;
+    int i, shrunk = 0;
+
+    for (i = 0; i < n; i++)
+        if (stats[i].valid && stats[i].final < stats[i].peak)
+            shrunk = 1;
+    if (!shrunk)
+        return;
+
+    printf("%5s %10s %10s %6s %10s  %s\n",
+           "valid", "peak KB", "final KB", "kept", "rss KB", "trace");
+    for (i = 0; i < n; i++) {
+        if (!stats[i].valid) {
+            printf("%5s %10s %10s %6s %10s  %s\n",
+                   "no", "-", "-", "-", "-", stats[i].filename);
+            continue;
+        }
+        printf("%5s %10.0f %10.0f %5.0f%% %10.0f  %s\n", "yes",
+               stats[i].peak / 1024, stats[i].final / 1024,
+               stats[i].final * 100.0 / stats[i].peak,
+               stats[i].rss / 1024, stats[i].filename);
+        peak += stats[i].peak;
+        final += stats[i].final;
+        rss += stats[i].rss;
+    }
+    if (peak > 0)
+        printf("%5s %10.0f %10.0f %5.0f%% %10.0f\n", "Total",
+               peak / 1024, final / 1024, final * 100.0 / peak, rss / 1024);
+}
+
+/*
+ * printstats - Print mm_get_stats of every trace as its util run left
+ *     the heap: sizes, the largest free block, extensions, splits and
+ *     coalescing cases; -V adds the free blocks of each class
+ */
+static void printstats(int n, stats_t *stats)
+{
+    mm_stats_t *h;
+    int i, c;
+
+    printf("%5s %8s %8s %8s %8s %8s %7s %7s %23s  %s\n",
+           "valid", "heap KB", "live KB", "free KB", "quick KB", "largest",
+           "extends", "splits", "coalesce 1/2/3/4", "trace");
+    for (i = 0; i < n; i++) {
+        h = &stats[i].heap;
+        if (!stats[i].valid) {
+            printf("%5s %8s %8s %8s %8s %8s %7s %7s %23s  %s\n", "no",
+                   "-", "-", "-", "-", "-", "-", "-", "-", stats[i].filename);
+            continue;
+        }
+        printf("%5s %8.0f %8.0f %8.0f %8.0f %8lu %7lu %7lu %5lu/%5lu/%5lu/%5lu  %s\n",
+               "yes", h->heap_bytes / 1024.0, h->live_bytes / 1024.0,
+               h->free_bytes / 1024.0, h->cached_bytes / 1024.0,
+               (unsigned long)h->largest_free, h->extends, h->splits,
+               h->coalesces[0], h->coalesces[1], h->coalesces[2],
+               h->coalesces[3], stats[i].filename);
+        if (verbose > 1) {
+            for (c = 0; c < h->nclasses; c++)
+                if (h->class_count[c])
+                    printf("%14s class %3d: %6lu blocks %10lu bytes\n", "",
+                           c, h->class_count[c], (unsigned long)h->class_bytes[c]);
+        }
+    }
+}
+
+/*
+ * hist_pct - Upper bound of the power-of-two bucket of an mm_profile_t
+ *     histogram that holds the pct-th percentile of its total values
+ */
+static unsigned long hist_pct(const unsigned long *hist, unsigned long total,
+                              double pct)
+{
+    unsigned long seen = 0;
+    int b;
+
+    for (b = 0; b < MM_PROF_BUCKETS; b++) {
+        seen += hist[b];
+        if (seen >= total * pct / 100)
+            break;
+    }
+    return b ? 1UL << b : 0;
+}
+
+/*
+ * printprofile - Print the phase profile of each trace's last timed run
+ *     (MMFLAGS=-DMM_PROFILE builds): calls, mean and percentile cycles,
+ *     and percentile probes; -V adds the cycle histograms
+ */
+static void printprofile(int n, stats_t *stats)
+{
+    static const char *names[MM_PHASES] = {
+        "find_fit", "insert", "coalesce", "extend"
+    };
+    mm_profile_t *p;
+    int i, ph, b;
+
+    if (n == 0 || !stats[0].profiled)
+        return;
+    printf("Phase cycles and probes of the last timed run (p50/p99: bucket bounds):\n");
+    printf("%-9s %8s %7s %7s %7s %9s %6s %6s  %s\n", "phase", "calls",
+           "mean", "p50", "p99", "max", "pr50", "pr99", "trace");
+    for (i = 0; i < n; i++) {
+        if (!stats[i].valid)
+            continue;
+        p = &stats[i].prof;
+        for (ph = 0; ph < MM_PHASES; ph++) {
+            if (p->calls[ph] == 0)
+                continue;
+            printf("%-9s %8lu %7.0f %7lu %7lu %9llu %6lu %6lu  %s\n",
+                   names[ph], p->calls[ph],
+                   (double)p->cycles[ph] / p->calls[ph],
+                   hist_pct(p->cycle_hist[ph], p->calls[ph], 50),
+                   hist_pct(p->cycle_hist[ph], p->calls[ph], 99),
+                   p->max_cycles[ph],
+                   hist_pct(p->probe_hist[ph], p->calls[ph], 50),
+                   hist_pct(p->probe_hist[ph], p->calls[ph], 99),
+                   stats[i].filename);
+            if (verbose > 1) {
+                for (b = 0; b < MM_PROF_BUCKETS; b++)
+                    if (p->cycle_hist[ph][b])
+                        printf("%9s < %-10lu %8lu\n", "",
+                               1UL << b, p->cycle_hist[ph][b]);
+            }
+        }
+    }
+}
+
+/*
+ * parse_option - Record a -o name=value[,value...] argument. At most one
+ *                option may list several values.
+ */
+static void parse_option(char *arg)
+{
+    char *eq = strchr(arg, '=');
+    char *val;
+
+    if (eq == NULL || eq == arg)
+        app_error("-o expects name=value, got \"%s\"\n", arg);
+    if (num_opts == MAXOPTS)
+        app_error("Too many -o options (max %d)\n", MAXOPTS);
+    *eq = '\0';
+    opt_names[num_opts] = arg;
+    opt_values[num_opts] = eq + 1;
+
+    if (strchr(eq + 1, ',') != NULL) {
+        if (variant_opt >= 0)
+            app_error("Only one -o option may list several values\n");
+        variant_opt = num_opts;
+        num_variants = 0;
+        for (val = strtok(eq + 1, ","); val != NULL; val = strtok(NULL, ",")) {
+            if (num_variants == MAXVARIANTS)
+                app_error("Too many values for -o %s (max %d)\n",
+                          arg, MAXVARIANTS);
+            variant_values[num_variants++] = val;
+        }
+    }
+    num_opts++;
+}
+
 /*
  * app_error - Report an arbitrary application error
  */
@@ -1428,7 +2406,7 @@ void malloc_error(const trace_t *trace, int opnum, const char *fmt, ...)
  */
 static void usage(void)
 {
-    fprintf(stderr, "Usage: mdriver [-hlVdD] [-f <file>]\n");
+    fprintf(stderr, "Usage: mdriver [-hlVdDS] [-f <file>] [-o <name>=<value>] [-C <n>] [-T <n>] [-H <size>]\n");
     fprintf(stderr, "Options\n");
     fprintf(stderr, "\t-p         Calculate Checkpoint Score.\n");
     fprintf(stderr, "\t-d <i>     Debug: 0 off; 1 default; 2 lots.\n");
@@ -1440,5 +2418,12 @@ static void usage(void)
     fprintf(stderr, "\t-V         Print diagnostics as each trace is run.\n");
     fprintf(stderr, "\t-v <i>     Set Verbosity Level to <i>\n");
     fprintf(stderr, "\t-s <s>     Timeout after s secs (default no timeout)\n");
+    fprintf(stderr, "\t-S         Free with mm_free_sized and the request size.\n");
     fprintf(stderr, "\t-f <file>  Use <file> as the trace file.\n");
+    fprintf(stderr, "\t-o <n>=<v> Set allocator option <n> (see mm_setopt).\n");
+    fprintf(stderr, "\t           <v1>,<v2>,... runs every value and compares them.\n");
+    fprintf(stderr, "\t-C <n>     Only time <n> rounds of constant-size mm_malloc/mm_free.\n");
+    fprintf(stderr, "\t-E <file>  Write allocator events of the util runs to <file> (MM_EVENTS builds).\n");
+    fprintf(stderr, "\t-T <n>     Also replay each trace in <n> threads (MM_THREADS builds).\n");
+    fprintf(stderr, "\t-H <size>  Reserve <size> bytes (K/M/G) for the heap (MM_LARGE builds).\n");
 }
@@ -3,6 +3,7 @@
  *						allows us to interleave calls from the student's malloc package 
  *						with the system's malloc package in libc.
  */
+#define _GNU_SOURCE             /* mremap */
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
@@ -11,7 +12,11 @@
 #include <string.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <time.h>
 #include <unistd.h>
+#ifdef MM_THREADS
+#include <pthread.h>
+#endif
 
 #include "memlib.h"
 #include "config.h"
@@ -20,11 +25,46 @@
 static char *heap;
 static char *mem_brk;
 static char *mem_max_addr;
+static size_t max_heap = MAX_HEAP;	/* bytes reserved for the heap */
+
+/* regions handed out by mem_map, outside the heap */
+typedef struct region {
+	char *start;
+	size_t size;
+	struct region *next;
+} region_t;
+static region_t *regions;
+static size_t map_bytes;		/* bytes in regions */
+static size_t peak_bytes;		/* high-water mark of heap + regions */
+static void (*reset_hook)(void);	/* see mem_set_reset_hook */
+static unsigned long sbrk_calls;	/* mem_sbrk calls that grew the heap ... */
+static double sbrk_secs;		/* ... and the time spent in them */
+
+#ifdef MM_THREADS
+static pthread_mutex_t brk_lock = PTHREAD_MUTEX_INITIALIZER;
+#define BRK_LOCK()		pthread_mutex_lock(&brk_lock)
+#define BRK_UNLOCK()	pthread_mutex_unlock(&brk_lock)
+#else
+#define BRK_LOCK()
+#define BRK_UNLOCK()
+#endif
+
+static void unmap_all(void);
+static void note_peak(void);
 
 /* 
  * mem_init - initialize the memory system model
  */
 void mem_init(void){
+#ifdef MM_LARGE
+	/* only reserve the address space; pages are backed as they are touched */
+	heap = mmap((void *)0x800000000, max_heap, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (heap == MAP_FAILED) {
+		fprintf(stderr, "ERROR: mem_init failed to reserve %zu bytes\n", max_heap);
+		exit(1);
+	}
+#else
 	int dev_zero = open("/dev/zero", O_RDWR);
 	heap = mmap((void *)0x800000000, /* suggested start*/
 			MAX_HEAP,				/* length */
@@ -32,44 +72,239 @@ void mem_init(void){
 			MAP_PRIVATE,			/* private or shared? */
 			dev_zero,				/* fd */
 			0);						/* offset (dunno) */
-	mem_max_addr = heap + MAX_HEAP;
+#endif
+	mem_max_addr = heap + max_heap;
 	mem_brk = heap;					/* heap is empty initially */
+	peak_bytes = 0;
+	sbrk_calls = 0;
+	sbrk_secs = 0;
 }
 
 /* 
  * mem_deinit - free the storage used by the memory system model
  */
 void mem_deinit(void){
-	munmap(heap, MAX_HEAP);
+	if (reset_hook)
+		reset_hook();
+	unmap_all();
+	munmap(heap, max_heap);
 }
 
 /*
  * mem_reset_brk - reset the simulated brk pointer to make an empty heap
  */
 void mem_reset_brk(){
+	if (reset_hook)
+		reset_hook();
+	unmap_all();
 	mem_brk = heap;
+	peak_bytes = 0;
+	sbrk_calls = 0;
+	sbrk_secs = 0;
 }
 
 /* 
  * mem_sbrk - simple model of the sbrk function. Extends the heap 
- *		by incr bytes and returns the start address of the new area. In
- *		this model, the heap cannot be shrunk.
+ *		by incr bytes and returns the start address of the new area
+ *		(the old brk). A negative incr shrinks the heap; only the model's
+ *		brk moves then, as the real one may have been moved by libc since.
  */
-void *mem_sbrk(int incr) {
-	char *old_brk = mem_brk;
+void *mem_sbrk(intptr_t incr) {
+	char *old_brk;
+	struct timespec t0, t1;
 
+	/* arenas extend the heap concurrently, and sbrk() itself is not thread safe */
+	BRK_LOCK();
+	old_brk = mem_brk;
+	if (incr < 0) {
+		if (mem_brk + incr < heap) {
+			BRK_UNLOCK();
+			errno = EINVAL;
+			fprintf(stderr, "ERROR: mem_sbrk failed. Shrunk below the heap start...\n");
+			return (void *)-1;
+		}
+		mem_brk += incr;
+		BRK_UNLOCK();
+		return (void *)old_brk;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t0);
     // call sbrk() in an attempt to have similar semantics as a real allocator.
-	if ( (incr < 0) || ((mem_brk + incr) > mem_max_addr) ||
-            sbrk(incr) == (void *) -1) {
+	// (not for GB-scale heaps: the data segment could not follow them)
+	if ( ((mem_brk + incr) > mem_max_addr)
+#ifndef MM_LARGE
+            || sbrk(incr) == (void *) -1
+#endif
+            ) {
+		BRK_UNLOCK();
 		errno = ENOMEM;
 		fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
 		return (void *)-1;
 	}
 
 	mem_brk += incr;
+	note_peak();
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	sbrk_calls++;
+	sbrk_secs += (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+	BRK_UNLOCK();
 	return (void *)old_brk;
 }
 
+/*
+ * mem_map - map a separate region of bytes (a multiple of the page
+ *		size) outside the heap; returns NULL if the system refuses
+ */
+void *mem_map(size_t bytes) {
+	region_t *r;
+	char *p = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+				   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+	if (p == MAP_FAILED)
+		return NULL;
+	if ((r = malloc(sizeof(region_t))) == NULL) {
+		munmap(p, bytes);
+		return NULL;
+	}
+	r->start = p;
+	r->size = bytes;
+	BRK_LOCK();
+	r->next = regions;
+	regions = r;
+	map_bytes += bytes;
+	note_peak();
+	BRK_UNLOCK();
+	return p;
+}
+
+/*
+ * mem_unmap - give a region from mem_map back to the system
+ */
+void mem_unmap(void *start) {
+	region_t **rp, *r;
+
+	BRK_LOCK();
+	for (rp = &regions; (r = *rp) != NULL; rp = &r->next)
+		if (r->start == start)
+			break;
+	assert(r != NULL);
+	*rp = r->next;
+	map_bytes -= r->size;
+	BRK_UNLOCK();
+	munmap(r->start, r->size);
+	free(r);
+}
+
+/*
+ * mem_remap - resize a region from mem_map to bytes; the kernel moves
+ *		the pages if it cannot grow the region where it is, without
+ *		copying them. Returns the new start or NULL
+ */
+void *mem_remap(void *start, size_t bytes) {
+	region_t *r;
+	char *p;
+
+	BRK_LOCK();
+	for (r = regions; r != NULL; r = r->next)
+		if (r->start == start)
+			break;
+	BRK_UNLOCK();
+	assert(r != NULL);
+	if ((p = mremap(start, r->size, bytes, MREMAP_MAYMOVE)) == MAP_FAILED)
+		return NULL;
+	BRK_LOCK();
+	map_bytes += bytes - r->size;
+	r->start = p;
+	r->size = bytes;
+	note_peak();
+	BRK_UNLOCK();
+	return p;
+}
+
+/*
+ * mem_mapped - is lo..hi inside one region from mem_map?
+ */
+int mem_mapped(const void *lo, const void *hi) {
+	region_t *r;
+	int found = 0;
+
+	BRK_LOCK();
+	for (r = regions; r != NULL && !found; r = r->next)
+		found = (char *)lo >= r->start && (char *)hi < r->start + r->size;
+	BRK_UNLOCK();
+	return found;
+}
+
+/*
+ * mem_purge - give the pages of start..start+bytes (page aligned) back
+ *		to the system; they read as zero when next touched
+ */
+void mem_purge(void *start, size_t bytes) {
+	madvise(start, bytes, MADV_DONTNEED);
+}
+
+/*
+ * mem_resident - returns the bytes of the heap and the regions that are
+ *		in physical memory
+ */
+size_t mem_resident(void) {
+	size_t pagesize = mem_pagesize(), pages, i, total = 0;
+	unsigned char *vec;
+	region_t *r;
+
+	pages = (mem_brk - heap + pagesize - 1) / pagesize;
+	if ((vec = malloc(pages + 1)) == NULL)
+		return 0;
+	if (mincore(heap, pages * pagesize, vec) == 0)
+		for (i = 0; i < pages; i++)
+			total += (vec[i] & 1) * pagesize;
+	free(vec);
+
+	BRK_LOCK();
+	for (r = regions; r != NULL; r = r->next) {
+		pages = r->size / pagesize;
+		if ((vec = malloc(pages)) == NULL)
+			break;
+		if (mincore(r->start, r->size, vec) == 0)
+			for (i = 0; i < pages; i++)
+				total += (vec[i] & 1) * pagesize;
+		free(vec);
+	}
+	BRK_UNLOCK();
+	return total;
+}
+
+/*
+ * mem_set_reset_hook - have hook called before the heap is reset or
+ *		unmapped, so that the allocator's own threads can let go of it
+ */
+void mem_set_reset_hook(void (*hook)(void)) {
+	reset_hook = hook;
+}
+
+/*
+ * unmap_all - drop every region left over from the last run
+ */
+static void unmap_all(void) {
+	region_t *r;
+
+	while ((r = regions) != NULL) {
+		regions = r->next;
+		munmap(r->start, r->size);
+		free(r);
+	}
+	map_bytes = 0;
+}
+
+/*
+ * note_peak - update the high-water mark; called with brk_lock held
+ */
+static void note_peak(void) {
+	size_t total = (size_t)(mem_brk - heap) + map_bytes;
+
+	if (total > peak_bytes)
+		peak_bytes = total;
+}
+
 /*
  * mem_heap_lo - return address of the first heap byte
  */
@@ -91,6 +326,47 @@ size_t mem_heapsize() {
 	return (size_t)((void *)mem_brk - (void *)heap);
 }
 
+/*
+ * mem_mapsize() - returns the bytes in regions from mem_map
+ */
+size_t mem_mapsize() {
+	return map_bytes;
+}
+
+/*
+ * mem_peaksize() - returns the most bytes the heap and the regions
+ *		together ever held since the last mem_reset_brk
+ */
+size_t mem_peaksize() {
+	return peak_bytes;
+}
+
+/*
+ * mem_maxsize() - returns the largest size the heap can grow to
+ */
+size_t mem_maxsize() {
+	return (size_t)(mem_max_addr - heap);
+}
+
+/*
+ * mem_sbrk_stats - how many mem_sbrk calls grew the heap since the last
+ *		mem_reset_brk, and the seconds they took
+ */
+void mem_sbrk_stats(unsigned long *calls, double *secs) {
+	*calls = sbrk_calls;
+	*secs = sbrk_secs;
+}
+
+#ifdef MM_LARGE
+/*
+ * mem_set_maxsize - set the bytes reserved for the heap by the next
+ *		mem_init (MAX_HEAP by default)
+ */
+void mem_set_maxsize(size_t bytes) {
+	max_heap = bytes;
+}
+#endif
+
 /*
  * mem_pagesize() - returns the page size of the system
  */
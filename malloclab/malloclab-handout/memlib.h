@@ -1,11 +1,26 @@
+#include <stdint.h>
 #include <unistd.h>
 
 void mem_init(void);               
 void mem_deinit(void);
-void *mem_sbrk(int incr);
+void *mem_sbrk(intptr_t incr);
+void *mem_map(size_t bytes);
+void mem_unmap(void *start);
+void *mem_remap(void *start, size_t bytes);
+int mem_mapped(const void *lo, const void *hi);
+void mem_purge(void *start, size_t bytes);
+size_t mem_resident(void);
+void mem_set_reset_hook(void (*hook)(void));
 void mem_reset_brk(void); 
 void *mem_heap_lo(void);
 void *mem_heap_hi(void);
 size_t mem_heapsize(void);
+size_t mem_mapsize(void);
+size_t mem_peaksize(void);
+size_t mem_maxsize(void);
+void mem_sbrk_stats(unsigned long *calls, double *secs);
+#ifdef MM_LARGE
+void mem_set_maxsize(size_t bytes);
+#endif
 size_t mem_pagesize(void);
 
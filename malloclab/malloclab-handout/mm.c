@@ -6,26 +6,89 @@
  * 
  *      Some Functions' Description:
  *          1)  使用了segregated_free_list
- *          2)  free_head[i]表示free_list中第i位块的hdr
- *              free_tail[i]表示free_list中第i位块的ftr
+ *          2)  SENTINEL(i)表示free_list中第i条链表的哨兵节点,
+ *              它的SUCC为表头, PRED为表尾
  *          3)  在malloc中，使用first_fit在合适的list里找合适的位置，随后将它从freelist中删除
  *          4)  在free中，将块free的方法是简单地将其放进free_list
  *          5)  在coalesce中，先从free_list中删除相邻空闲块，把它们合并之后再重新加入free_list
+ *          6)  每条链表都是带哨兵节点的循环双向链表, 插入策略可选:
+ *              LIFO/FIFO 为 O(1), 按地址排序(ADDR)为 O(n), 用 mm_setopt("list", ...) 选择
+ *          7)  两级位图记录非空链表. mm_setopt("index", "tlsf") 切换为 TLSF 分级:
+ *              一级为 2 的幂, 二级把每个幂次等分为 SL_COUNT 份; find_fit 把请求
+ *              上取整到下一个二级类, 再用 ffs 在位图中 O(1) 找到非空链表取表头;
+ *              默认的 seg 分级用 clz O(1) 算出链表, 以 -DSEG_SUB_LOG=n 编译时每个
+ *              2 的幂再等分为 2^n 个子类 (seg_bound 表在编译期生成);
+ *              "exact" 则对不超过 EXACT_MAX 的每个 8 字节大小各设一个精确的 bin,
+ *              其上仍按 2 的幂分级, 小请求用一次位图扫描找到非空 bin 直接取表头
+ *          8)  以 -DFOOTER_ELISION 编译时已分配块没有尾部, 头部第 1 位记录前一块
+ *              是否已分配 (P), coalesce 只在前一块空闲时才读它的尾部
+ *          9)  不超过 slab_max 字节的请求由 slab 层分配: 每个 run 是一个按页对齐的
+ *              已分配块, 页首是 run 头 (空闲位图), 对象本身没有头尾; 对象地址
+ *              按页掩码即得 run 头, run_map 中每页一位记录该页是否是 run
+ *          10) 链表, 位图, slab 等状态属于一个 arena (arena_t, 放在它的第一段堆的开头),
+ *              函数都操作当前 arena ar. 以 -DMM_THREADS 编译时有 MM_ARENAS 个 arena,
+ *              线程轮流绑定, 每个 arena 一把锁; 堆由各 arena 交错扩展, 不相邻的扩展
+ *              另起一段 (序言块 + 结尾块), 所以合并不会跨 arena. 已分配块头部的
+ *              高 4 位记录所属 arena, free 据此锁住正确的 arena
+ *          11) tcache: 每个线程为 TCACHE_BINS 种小块各留一条单链表 (链接在载荷里),
+ *              块在其中仍标记为已分配; 命中时不碰头尾标记也不加锁. 未命中时在
+ *              arena 锁内一次取一批, 满了一次还回一半, 线程退出时全部还回
+ *          12) 不小于 mmap_threshold 字节的请求各占一个 mem_map 映射的区域, 不在堆里:
+ *              区域开头记录映射长度, 块头部带 MAPPED 位; free 立即解除映射,
+ *              realloc 用 mem_remap 改变区域大小而不复制数据
+ *          13) 释放后堆顶的空闲块超出保留的顶部余量 (trim_threshold 按 CHUNKSIZE
+ *              向上取整) 至少 trim_threshold 字节时, 用负的 mem_sbrk 还回超出的
+ *              部分, 结尾块下移 (MM_THREADS 下不收缩: 堆顶可能是别的 arena 的段)
+ *          14) 不小于 purge_threshold 字节的空闲块, 其内部整页 (头尾标记和链接之外)
+ *              用 mem_purge 还给系统, 头部记 PURGED 位; 可以在 free 时立即做,
+ *              每 PURGE_EVERY 次 free 扫描一遍, 或 (MM_THREADS) 由后台线程定时扫描
+ *          15) large_mode 为 LARGE_TREE 时, 大于 TREE_MIN 的空闲块不进链表, 而进
+ *              arena 的一棵 treap: 按 (大小, 地址) 排序, 优先级是地址的散列,
+ *              左右孩子以相对偏移存在前驱/后继的位置; 在树上做精确的最佳适配
+ *          16) 不超过 fast_max 字节的块释放时先推迟合并: 按大小放进 arena 的快速
+ *              链表 (单链表, 仍标记为已分配, 不碰邻块), 同样大小的 malloc 直接取走;
+ *              find_fit 落空, 扩展堆之前, 或快速链表里累计超过 fast_limit 字节时,
+ *              consolidate 才把它们真正释放并合并
+ *          17) 链表内的查找策略 fit_policy: first fit; next fit, 每条链表一个游标
+ *              (rover) 从上次找到的位置继续; best-of-K, 取前 K 个够大的块中最小的
+ *              (K 为 0 时整条链表), 遇到大小正好的块立即停止
+ *          18) grow_mode 为 GROW_ADAPT 时堆每次至少扩展 ar->grow 字节: 距上次扩展
+ *              不到 GROW_WINDOW 次 malloc 就翻倍, 每空闲一个窗口减半, 但超出请求的
+ *              部分不超过堆大小的 grow_budget%
+ *          19) wild_mode 时紧挨 arena 结尾块的空闲块 (wilderness) 不进链表, 记在
+ *              ar->wild: 链表找不到时直接从它切出新块 (只调整头尾, 不碰链表),
+ *              不够时只扩展差额并与它合并
+ *          20) memalign / posix_memalign / aligned_alloc 由 alloc_aligned 在堆中
+ *              分配, 对齐前的空隙拆成空闲块; align 选项让不小于它的 malloc
+ *              请求也按它对齐 (如 64 字节缓存行)
+ *          21) free_sized 用调用者给的大小直接选 tcache bin 或快速链表, 不读
+ *              头部; malloc_usable_size 报告块里可用的全部载荷
+ *          22) malloc_batch 从一个空闲块 (或一次扩展) 连续切出 n 块, 只做一次
+ *              链表操作; free_batch 按地址排序, 把相邻的一串块并成一块再释放
+ *          23) 以 -DMM_PROFILE 编译时 find_fit, insertNode, coalesce 和 extend_heap
+ *              各是一个阶段: 用 rdtsc 计时, 连同查看的块数记入每个 arena 的直方图;
+ *              不定义时 PROF_PHASE / PROF_PROBE 展开为空
+ *          24) 以 -DMM_EVENTS 编译时每个公开调用在 ev_ring 里记一个事件 (时间, 耗时,
+ *              大小, 地址, 类, 查看的块数, 是否拆分/合并/扩展), 槽位用原子加法
+ *              领取, 满了覆盖最旧的; 每 EV_SAMPLE 个事件记一次堆大小, 已分配,
+ *              空闲字节和各类空闲块数. mm_flush_events 写出, mmevents 转成 JSON
  * 
  *      Data Structure's Description:
  * 
  *  Allocated Block:
  *               31                      3 2  1  0
  *              +-------------------------+-----+-+
- *    Header:   |           size          |     |A|
+ *    Header:   |           size          |  |P|A|
  *       bp ->  +-------------------------+-----+-+
  *              |                                 |
  *              |     Payload and padding         |
  *              |          (optional)             |
  *              +-------------------------+-----+-+
- *    Footer:   |           size          |     |A|
+ *    Footer:   |           size          |     |A|   (not with FOOTER_ELISION)
  *              +-------------------------+-----+-+
  * 
+ *      P (prev-alloc) is only kept with FOOTER_ELISION, and is 0 otherwise.
+ * 
  *  Free block:
  *               31                      3 2  1  0
  *              +-------------------------+-----+-+
@@ -58,9 +121,9 @@
  *              |           0             |     |A|
  *  end of heap +-------------------------+-----+-+
  * 
- *  Segregated Free Lists: 双向链表
+ *  Segregated Free Lists: 带哨兵的循环双向链表 (empty list: sentinel <-> itself)
  *      +----+             +----+            +----+
- *      |    |  <——————>   |  A |  <——————>  |  B | ...
+ *      |  S |  <——————>   |  A |  <——————>  |  B | ... <——> S
  *      +----+             +----+            +----+
  *      |    |
  *      +----+
@@ -83,11 +146,24 @@
 
 
 #include <assert.h>
+#include <errno.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#ifdef MM_THREADS
+#include <pthread.h>
+#include <time.h>
+#endif
+#if defined(MM_PROFILE) || defined(MM_EVENTS)
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#endif
 
+#define MM_NO_INLINE   /* 本文件定义的就是 malloc 本身 */
 #include "mm.h"
 #include "memlib.h"
 
@@ -108,32 +184,120 @@
 #define free mm_free
 #define realloc mm_realloc
 #define calloc mm_calloc
+#define memalign mm_memalign
+#define posix_memalign mm_posix_memalign
+#define aligned_alloc mm_aligned_alloc
+#define free_sized mm_free_sized
+#define malloc_usable_size mm_malloc_usable_size
+#define malloc_batch mm_malloc_batch
+#define malloc_fixed mm_malloc_fixed
+#define free_batch mm_free_batch
 #endif /* def DRIVER */
 
-/* Basic constants and macros */
+/* Basic constants and macros; -DMM_LARGE uses 8-byte tags and links
+ * so that blocks, offsets and the heap may pass 4 GB */
+#ifdef MM_LARGE
+typedef unsigned long word_t;   /* header/footer, free-list link */
+typedef long sword_t;
+#define WSIZE       8       /* Word and header/footer size (bytes) */
+#define DSIZE       16      /* Double word size (bytes) */
+#define BLOCKSIZE   32      /* 最小块字节数 */
+#else
+typedef unsigned int word_t;
+typedef int sword_t;
 #define WSIZE       4       /* Word and header/footer size (bytes) */
 #define DSIZE       8       /* Double word size (bytes) */
 #define BLOCKSIZE   16      /* 最小块字节数 */
-#define INFOSIZE    8       /* 头尾字节总数 */
+#endif
+#ifdef FOOTER_ELISION
+#define INFOSIZE    WSIZE   /* 已分配块只有头部 */
+#define PREV_ALLOC  0x2     /* 头部中的 prev-alloc 位 */
+#else
+#define INFOSIZE    DSIZE   /* 头尾字节总数 */
+#define PREV_ALLOC  0
+#endif
 #define CHUNKSIZE   0x150   /* Extend heap by this amount (bytes) */ 
+#define MAPPED      0x4     /* 头部中的 mmap 位 */
+#define PURGED      0x4     /* 空闲块头部的同一位: 内部整页已还给系统 */
 
 #define MAX(x, y) ((x) > (y)? (x) : (y))  
+#define MIN(x, y) ((x) < (y)? (x) : (y))
 
-/* single word (4) or double word (8) alignment */
-#define ALIGNMENT 8
+/* double word alignment */
+#define ALIGNMENT DSIZE
+
+#if MM_BLOCKSIZE != BLOCKSIZE || MM_INFOSIZE != INFOSIZE || MM_ALIGNMENT != ALIGNMENT
+#error "mm.h block rounding disagrees with mm.c"
+#endif
 
 /* rounds up to the nearest multiple of ALIGNMENT */
-#define ALIGN(size) (((size_t)(size) + (ALIGNMENT - 1)) & ~0x7)
+#define ALIGN(size) (((size_t)(size) + (ALIGNMENT - 1)) & ~(size_t)(ALIGNMENT - 1))
 
 /* Pack a size and allocated bit into a word */
 #define PACK(size, alloc)  ((size) | (alloc)) 
 
 /* Read and write a word at address p */
-#define GET(p) (*(unsigned int *)(p))            
-#define PUT(p, val) (*(unsigned int *)(p) = (val))  
+#define GET(p) (*(word_t *)(p))            
+#define PUT(p, val) (*(word_t *)(p) = (val))  
+
+/* Arenas: allocated headers of threaded builds keep the owner's id in
+ * the bits above ARENA_SHIFT, so sizes must stay below 1 << ARENA_SHIFT */
+#ifdef MM_THREADS
+#ifndef MM_ARENAS
+#define MM_ARENAS   8
+#endif
+#define ARENA_SHIFT (WSIZE * 8 - 4)
+#define SIZE_MASK   ((((word_t)1 << ARENA_SHIFT) - 1) & ~(word_t)0x7)
+#define OWNER_BITS  ((word_t)ar->id << ARENA_SHIFT)
+#else
+#define MM_ARENAS   1
+#define SIZE_MASK   (~(word_t)0x7)
+#define OWNER_BITS  0
+#endif
+
+/* Phase profile (-DMM_PROFILE): PROF_PHASE(ph) at the top of a function
+ * times the call until it returns, PROF_PROBE() counts a block looked at */
+#if defined(MM_PROFILE) || defined(MM_EVENTS)
+#if defined(__x86_64__) || defined(__i386__)
+#define PROF_NOW()      __rdtsc()
+#else
+#define PROF_NOW()      prof_ns()
+#endif
+#define PROF_PROBE()    (probes++)
+#else
+#define PROF_PROBE()    ((void)0)
+#endif
+#ifdef MM_PROFILE
+#define PROF_BUCKET(v)  ((v) ? MIN(64 - __builtin_clzll(v), MM_PROF_BUCKETS - 1) : 0)
+#define PROF_PHASE(ph)  __attribute__((cleanup(prof_end))) prof_scope_t prof_scope = \
+                            { (ph), PROF_NOW(), probes }
+#else
+#define PROF_PHASE(ph)  ((void)0)
+#endif
+
+/* Event trace (-DMM_EVENTS): EV_BEGIN() starts a public call, which
+ * EV_RET(op, size, p) (returning p) or EV_END ends with one event;
+ * EV_FLAG(f) marks what the call did */
+#ifdef MM_EVENTS
+#define EV_SAMPLE       128                     /* events between counter records */
+#ifdef MM_THREADS
+#define EV_CLAIM()      __atomic_fetch_add(&ev_head, 1, __ATOMIC_RELAXED)
+#else
+#define EV_CLAIM()      (ev_head++)
+#endif
+#define EV_BEGIN()      ev_scope_t ev = { PROF_NOW(), probes, ev_flags }; ev_flags = 0
+#define EV_RET(op, size, p) ev_end(&ev, (op), (size), (p))
+#define EV_END(op, size, p) ((void)ev_end(&ev, (op), (size), (p)))
+#define EV_FLAG(f)      (ev_flags |= (f))
+#else
+#define EV_BEGIN()      ((void)0)
+#define EV_RET(op, size, p) (p)
+#define EV_END(op, size, p) ((void)0)
+#define EV_FLAG(f)      ((void)0)
+#endif
 
 /* Read the size and allocated fields from address p */
-#define GET_SIZE(p) (GET(p) & ~0x7)                   
+#define GET_SIZE(p) (GET(p) & SIZE_MASK)                   
 #define GET_ALLOC(p) (GET(p) & 0x1)      
 
 /* Given block ptr bp, compute address of its header and footer */
@@ -144,418 +308,2402 @@
 #define NEXT_BLKP(bp)  ((char *)(bp) + GET_SIZE(((char *)(bp) - WSIZE)))
 #define PREV_BLKP(bp)  ((char *)(bp) - GET_SIZE(((char *)(bp) - DSIZE)))
 
+/* Write the tags of an allocated/free block of size bytes at bp, keeping
+ * its prev-alloc bit; allocated blocks get no footer with FOOTER_ELISION */
+#ifdef FOOTER_ELISION
+#define SET_ALLOC(bp, size) \
+    PUT(HDRP(bp), PACK(size, 1) | OWNER_BITS | (GET(HDRP(bp)) & PREV_ALLOC))
+#define SET_FREE(bp, size) do { \
+    PUT(HDRP(bp), PACK(size, 0) | (GET(HDRP(bp)) & PREV_ALLOC)); \
+    PUT(FTRP(bp), PACK(size, 0)); } while (0)
+#define SET_PREV_ALLOC(bp) PUT(HDRP(bp), GET(HDRP(bp)) | PREV_ALLOC)
+#define CLR_PREV_ALLOC(bp) PUT(HDRP(bp), GET(HDRP(bp)) & ~PREV_ALLOC)
+#define PREV_ALLOCED(bp) (GET(HDRP(bp)) & PREV_ALLOC)
+#else
+#define SET_ALLOC(bp, size) do { \
+    PUT(HDRP(bp), PACK(size, 1) | OWNER_BITS); \
+    PUT(FTRP(bp), PACK(size, 1)); } while (0)
+#define SET_FREE(bp, size) do { \
+    PUT(HDRP(bp), PACK(size, 0)); \
+    PUT(FTRP(bp), PACK(size, 0)); } while (0)
+#define SET_PREV_ALLOC(bp)
+#define CLR_PREV_ALLOC(bp)
+#define PREV_ALLOCED(bp) GET_ALLOC((char *)(bp) - DSIZE)
+#endif
+
 /* 简化操作 */
 #define THIS_SIZE(bp) (GET_SIZE(HDRP(bp)))                              /* bp指向块大小 */
 #define PREV_SIZE(bp) (GET_SIZE((char *)(bp) - DSIZE))                  /* bp前一块大小 */
 #define NEXT_SIZE(bp) (GET_SIZE((char *)(bp) + THIS_SIZE(bp) - WSIZE))  /* bp后一块大小 */
 #define THIS_ALLOC(bp) (GET_ALLOC(HDRP(bp)))                            /* bp指向块分配与否 */
 
-/* 显式空闲链表相关定义 */
-#define GET_PRED(bp) ((char *)(bp) - GET(bp)) /* 获得祖先的值 */
-#define GET_SUCC(bp) ((char *)(bp) + GET((char *)(bp) + WSIZE))  /* 获得后继的值 */
+/* 显式空闲链表相关定义, 偏移量为有符号数 (LIFO/FIFO下前驱后继可在任意方向) */
+#define GET_PRED(bp) ((char *)(bp) - (sword_t)GET(bp)) /* 获得祖先的值 */
+#define GET_SUCC(bp) ((char *)(bp) + (sword_t)GET((char *)(bp) + WSIZE))  /* 获得后继的值 */
+
+#define PUT_PRED(bp, pred) PUT(bp, (word_t)((char *)(bp) - (char *)(pred))) /* 给祖先赋值 */
+#define PUT_SUCC(bp, succ) PUT((char *)(bp) + WSIZE, (word_t)((char *)(succ) - (char *)(bp))) /* 给后继赋值 */
+
+/* 空闲链表相关常量 */
+/* Seg classes: 0 holds 16-byte blocks, each range (2^m, 2^(m+1)] for
+ * m = 4..21 is cut into SEG_SUB equal classes, and the last class holds
+ * everything above 4 MB. -DSEG_SUB_LOG=n (0..3) gives 2^n per power */
+#ifndef SEG_SUB_LOG
+#define SEG_SUB_LOG 0
+#endif
+#if SEG_SUB_LOG < 0 || SEG_SUB_LOG > 3
+#error "SEG_SUB_LOG must be 0..3"
+#endif
+#define SEG_SUB     (1 << SEG_SUB_LOG)
+#define NCLASSES    (2 + 18 * SEG_SUB)      /* 空闲链表数 */
+
+/* Largest size of sub-class j of (2^m, 2^(m+1)], and one table row of
+ * them per power of two */
+#define SEG_BOUND(m, j) ((word_t)(SEG_SUB + (j) + 1) << ((m) - SEG_SUB_LOG))
+#define SEG_ROW_0(m) SEG_BOUND(m, 0),
+#define SEG_ROW_1(m) SEG_ROW_0(m) SEG_BOUND(m, 1),
+#define SEG_ROW_2(m) SEG_ROW_1(m) SEG_BOUND(m, 2), SEG_BOUND(m, 3),
+#define SEG_ROW_3(m) SEG_ROW_2(m) SEG_BOUND(m, 4), SEG_BOUND(m, 5), \
+                     SEG_BOUND(m, 6), SEG_BOUND(m, 7),
+#define SEG_ROW__(n, m) SEG_ROW_##n(m)
+#define SEG_ROW_(n, m)  SEG_ROW__(n, m)
+#define SEG_ROW(m)      SEG_ROW_(SEG_SUB_LOG, m)
+#define LIST_LIFO   0       /* 插入表头, O(1) */
+#define LIST_FIFO   1       /* 插入表尾, O(1) */
+#define LIST_ADDR   2       /* 按地址排序, O(n) */
+
+/* 链表内的查找策略 */
+#define FIT_FIRST   0       /* 第一个够大的块 */
+#define FIT_NEXT    1       /* 从本链表的游标开始的 first fit */
+#define FIT_BEST    2       /* 前 fit_k 个够大的块中最小的 */
+
+/* 堆的扩展方式 */
+#define GROW_FIXED  0       /* MAX(请求, CHUNKSIZE) */
+#define GROW_ADAPT  1       /* 按扩展频率翻倍/减半, 受 grow_budget 限制 */
+#define GROW_WINDOW 64      /* mallocs between extensions that count as a burst */
+
+/* 分级方式 */
+#define INDEX_SEG   0       /* 2 的幂分级, 逐个链表 first fit */
+#define INDEX_TLSF  1       /* Two-Level Segregated Fit, 位图 good fit */
+#define INDEX_EXACT 2       /* 小块精确 bin, 大块 2 的幂分级 */
+
+/* Exact bins: class size/8 for sizes up to EXACT_MAX, then one class
+ * per power of two, like the seg classes */
+#define EXACT_MAX   512
+#define EXACT_BINS  ((EXACT_MAX >> 3) + 1)      /* bins 0, 1 stay empty */
+#define EXACT_CLASSES (EXACT_BINS + 18)         /* (2^9, 2^10] .. (2^26, 2^27] */
+
+/* TLSF: class = fl * SL_COUNT + sl */
+#define SL_LOG      3                       /* log2 of second-level lists per fl */
+#define SL_COUNT    (1 << SL_LOG)
+#define FL_SHIFT    (SL_LOG + 3)            /* below 1<<FL_SHIFT: fl 0, 8-byte steps */
+#ifdef MM_LARGE
+#define FL_COUNT    32                      /* covers sizes < 1<<37 */
+#else
+#define FL_COUNT    22                      /* covers sizes < 1<<27 > MAX_HEAP */
+#endif
+#define TLSF_CLASSES (FL_COUNT * SL_COUNT)
+#define FL_MAX      32                      /* bits in fl_bitmap */
+#if NCLASSES > MM_STAT_CLASSES || TLSF_CLASSES > MM_STAT_CLASSES || EXACT_CLASSES > MM_STAT_CLASSES
+#error "mm_stats_t has too few classes"
+#endif
+
+/* Given class index i, compute address of its sentinel node */
+#define SENTINEL(i) (ar->free_lists + (i) * DSIZE)
+
+/* Sentinels lie below every block of their arena */
+#define IS_SENTINEL(p) ((char *)(p) < ar->free_lists + nclasses * DSIZE)
+
+/* Slab 层: 对象大小为 8, 16, ..., SLAB_CLASSES * 8 字节 */
+#define RUN_SHIFT       12
+#define RUN_SIZE        (1 << RUN_SHIFT)    /* 一个 run 占一页 */
+#define SLAB_CLASSES    8
+#define SLAB_MAX        (SLAB_CLASSES * DSIZE)
+
+/* Given a slab object, compute address of its run header */
+#define RUN_OF(p)   ((slab_run *)((size_t)(p) & ~(size_t)(RUN_SIZE - 1)))
+
+/* Is p inside a slab run? (run_map has one bit per heap page) */
+#define IS_RUN(p)   (((size_t)((char *)(p) - heap_lo) >> RUN_SHIFT) < run_map_pages && \
+    (run_map[((char *)(p) - heap_lo) >> (RUN_SHIFT + 3)] >> \
+        ((((char *)(p) - heap_lo) >> RUN_SHIFT) & 7) & 1))
+
+/* Header at the start of every run; objects follow at RUN_HDRSIZE */
+typedef struct slab_run {
+    struct slab_run *next;      /* partial runs of the same class */
+    struct slab_run *prev;
+    struct arena *arena;        /* owner */
+    unsigned short size;        /* object size */
+    unsigned short nobjs;       /* objects in this run */
+    unsigned short nfree;       /* free objects in this run */
+    unsigned short cls;         /* size / DSIZE - 1 */
+    unsigned long long freemap[RUN_SIZE / DSIZE / 64];  /* 1 -> slot free */
+} slab_run;
+#define RUN_HDRSIZE ALIGN(sizeof(slab_run))
 
-#define PUT_PRED(bp, pred) PUT(bp, (unsigned int)((char *)(bp) - (char *)(pred))) /* 给祖先赋值 */
-#define PUT_SUCC(bp, succ) PUT((char *)(bp) + WSIZE, (unsigned int)((char *)(succ) - (char *)(bp))) /* 给后继赋值 */
+/* Mapped blocks: the region's length, then the block header */
+#define MAP_HDRSIZE     (2 * DSIZE)
+#define MAP_LEN(bp)     (*(size_t *)((char *)(bp) - MAP_HDRSIZE))
+#define IS_MAPPED(bp)   (GET(HDRP(bp)) & MAPPED)    /* not for slab objects */
 
-/* 四种节点类型 */
-#define ALLNULL     0
-#define HEADNULL    1
-#define TAILNULL    2
-#define NORMAL      3
+/* Large free blocks in a treap keyed by (size, address) instead of the
+ * lists; children are relative offsets in the link words, 0 for none */
+#define LARGE_LIST      0
+#define LARGE_TREE      1
+#define TREE_MIN        4096                    /* larger blocks go to the tree */
+#define IS_TREE(size)   (large_mode == LARGE_TREE && (size) > TREE_MIN)
+#define GET_LEFT(bp)    (GET(bp) ? (char *)(bp) + (sword_t)GET(bp) : NULL)
+#define GET_RIGHT(bp)   (GET((char *)(bp) + WSIZE) ? \
+                            (char *)(bp) + (sword_t)GET((char *)(bp) + WSIZE) : NULL)
+#define PUT_LEFT(bp, p) PUT(bp, (p) ? (word_t)((char *)(p) - (char *)(bp)) : 0)
+#define PUT_RIGHT(bp, p) PUT((char *)(bp) + WSIZE, \
+                            (p) ? (word_t)((char *)(p) - (char *)(bp)) : 0)
+#define PRIORITY(bp)    ((unsigned int)((size_t)(bp) >> 3) * 2654435761U)
+#define TREE_LESS(a, b) (THIS_SIZE(a) < THIS_SIZE(b) || \
+                         (THIS_SIZE(a) == THIS_SIZE(b) && (char *)(a) < (char *)(b)))
+
+/* Purging of the interior pages of large free blocks */
+#define PURGE_EAGER     0       /* when the block is freed */
+#define PURGE_BATCH     1       /* sweep the lists every PURGE_EVERY frees */
+#define PURGE_THREAD    2       /* sweep from a thread every PURGE_MS */
+#define PURGE_EVERY     256
+#define PURGE_MS        10
+
+/* Per-thread cache of small blocks: bin b holds blocks of
+ * BLOCKSIZE + b * DSIZE bytes, still marked allocated */
+#define TCACHE_BINS     16
+#define TCACHE_MAX      255                     /* largest tcache_cap */
+#define TC_BIN(bytes)   (((bytes) - BLOCKSIZE) / DSIZE)
+
+/* Quick lists of deferred frees: bin b holds blocks of
+ * BLOCKSIZE + b * DSIZE bytes, still marked allocated */
+#define FAST_BINS       64
+#define FAST_MAX        (BLOCKSIZE + (FAST_BINS - 1) * DSIZE)   /* largest fast_max */
+#define FAST_BIN(bytes) (((bytes) - BLOCKSIZE) / DSIZE)
+
+typedef struct tcache {
+    char *bins[TCACHE_BINS];            /* linked through the first payload word */
+    unsigned char counts[TCACHE_BINS];
+    unsigned long hits, misses;
+} tcache_t;
+
+#ifdef MM_PROFILE
+/* One arena's profile, kept outside the heap so it does not change util */
+typedef struct {
+    mm_profile_t p;
+} prof_t;
+
+/* A phase in progress */
+typedef struct {
+    int phase;
+    unsigned long long start;
+    unsigned long probes;
+} prof_scope_t;
+#endif
+
+#ifdef MM_EVENTS
+/* A public call in progress, and the flags of the call around it */
+typedef struct {
+    unsigned long long start;
+    unsigned long probes;
+    unsigned char flags;
+} ev_scope_t;
+#endif
+
+/* Everything one arena needs; lives at the start of its first segment */
+typedef struct arena {
+    char *free_lists;           /* sentinel nodes of every list */
+    unsigned int *sl_bitmap;    /* bit s of word f: class f*SL_COUNT+s non-empty */
+    unsigned int fl_bitmap;     /* bit f: sl_bitmap[f] != 0 */
+    int id;                     /* index in arenas[] */
+    slab_run **slab_partial;    /* runs with free slots, per slab class */
+    char *brk_end;              /* end of the arena's last segment */
+    char *tree;                 /* root of the large-block treap */
+    unsigned int frees;         /* frees since the last batch purge */
+    char **fast;                /* fast_bins quick lists, linked through the payload */
+    size_t fast_bytes;          /* bytes held in the quick lists */
+    char **rover;               /* FIT_NEXT: where each list's search resumes */
+    char *wild;                 /* wild_mode: free block before brk_end, or NULL */
+    size_t grow;                /* GROW_ADAPT: bytes of the next extension */
+    unsigned long allocs;       /* alloc_block calls */
+    unsigned long last_grow;    /* allocs at the last extension */
+    word_t *cls_count;          /* free blocks of each class, tree and wilderness included */
+    word_t *cls_bytes;          /* ... and their bytes */
+    size_t free_bytes;          /* bytes of all free blocks */
+    size_t block_bytes;         /* bytes of all blocks, prologues excluded */
+    unsigned long extends;      /* extend_heap calls */
+    unsigned long splits;       /* remainders split off by trim_block */
+    unsigned long merges[4];    /* coalesce calls by case */
+#ifdef MM_THREADS
+    pthread_mutex_t lock;
+#endif
+} arena_t;
+
+/* Enter/leave the arena a for one public call */
+#ifdef MM_THREADS
+#define ENTER(a)    do { ar = (a); pthread_mutex_lock(&ar->lock); } while (0)
+#define LEAVE()     pthread_mutex_unlock(&ar->lock)
+#define HOME()      home_arena()
+#define OWNER(bp)   (IS_RUN(bp) ? RUN_OF(bp)->arena : \
+                        arenas[GET(HDRP(bp)) >> ARENA_SHIFT])
+#else
+#define ENTER(a)
+#define LEAVE()
+#endif
 
 /* Global variables */
 static char *heap_listp = NULL;  
-static size_t *free_head;  /* point to every list head */
-static size_t *free_tail;  /* point to every list tail */
+static int list_policy = LIST_FIFO;     /* insertion discipline */
+static int index_mode = INDEX_SEG;      /* how sizes map to classes */
+static int index_opt = INDEX_SEG;       /* index_mode from the next mm_init */
+static int large_mode = LARGE_LIST;     /* where blocks over TREE_MIN go */
+static int large_opt = LARGE_LIST;      /* large_mode from the next mm_init */
+static int nclasses;                    /* number of lists for index_mode */
+
+/* Largest block size of each seg class, built at compile time */
+static const word_t seg_bound[NCLASSES] = {
+    1 << 4,
+    SEG_ROW(4)  SEG_ROW(5)  SEG_ROW(6)  SEG_ROW(7)  SEG_ROW(8)  SEG_ROW(9)
+    SEG_ROW(10) SEG_ROW(11) SEG_ROW(12) SEG_ROW(13) SEG_ROW(14) SEG_ROW(15)
+    SEG_ROW(16) SEG_ROW(17) SEG_ROW(18) SEG_ROW(19) SEG_ROW(20) SEG_ROW(21)
+    (word_t)-1
+};
+static char *heap_lo;                   /* first byte of the heap */
+static size_t slab_max = 0;             /* largest request served by slabs, 0: off */
+static size_t slab_opt = 0;             /* slab_max from the next mm_init */
+static unsigned char *run_map;          /* bit per heap page: page is a run */
+static size_t run_map_pages;            /* pages covered by run_map */
+static int tcache_cap = 0;              /* blocks per tcache bin, 0: off */
+static size_t mmap_threshold = 0;       /* smallest mapped request, 0: off */
+static size_t min_align = 0;            /* align malloc requests of this many bytes, 0: off */
+static size_t trim_threshold = 0;      /* free top bytes beyond the pad released, 0: off */
+static size_t purge_threshold = 0;      /* smallest free block purged, 0: off */
+static int purge_mode = PURGE_EAGER;
+static int purge_mode_opt = PURGE_EAGER; /* purge_mode from the next mm_init */
+static size_t fast_max = 0;             /* largest block whose free is deferred, 0: off */
+static size_t fast_opt = 0;             /* fast_max from the next mm_init */
+static size_t fast_bins;                /* quick lists per arena for fast_max */
+static int fit_policy = FIT_FIRST;      /* search within a list */
+static int fit_opt = FIT_FIRST;         /* fit_policy from the next mm_init */
+static int fit_k = 0;                   /* FIT_BEST candidates, 0: whole list */
+static int grow_mode = GROW_FIXED;      /* how far the heap is extended */
+static int grow_budget = 10;            /* GROW_ADAPT slack, % of the heap */
+static int wild_mode = 0;               /* keep the tail block out of the lists */
+static int wild_opt = 0;                /* wild_mode from the next mm_init */
+static size_t fast_limit = 0x10000;     /* quick-list bytes that force a consolidation */
+static unsigned long tc_hits, tc_misses;/* counts of caches already drained */
+#ifdef MM_THREADS
+static arena_t *arenas[MM_ARENAS];
+static __thread arena_t *ar;            /* arena this thread is working on */
+static __thread arena_t *home;          /* arena this thread allocates from */
+static __thread unsigned int home_gen;  /* heap_gen when home was bound */
+static unsigned int heap_gen;           /* bumped by mm_init */
+static unsigned int next_arena;         /* round-robin thread binding */
+static pthread_mutex_t arenas_lock = PTHREAD_MUTEX_INITIALIZER;
+static __thread tcache_t *tc;           /* this thread's cache */
+static __thread unsigned int tc_gen;    /* heap_gen when tc was made */
+static pthread_key_t tc_key;            /* drains tc at thread exit */
+static pthread_once_t tc_once = PTHREAD_ONCE_INIT;
+static pthread_t purger;                /* PURGE_THREAD sweeper */
+static int purger_on;
+static int purger_stop;
+static pthread_mutex_t purge_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t purge_cond = PTHREAD_COND_INITIALIZER;
+#else
+static arena_t *ar;                     /* the only arena */
+static tcache_t *tc;
+#endif
+#ifdef MM_PROFILE
+static prof_t profs[MM_ARENAS];         /* per arena, indexed by id */
+#endif
+#if defined(MM_PROFILE) || defined(MM_EVENTS)
+#ifdef MM_THREADS
+static __thread unsigned long probes;   /* PROF_PROBE calls of this thread */
+#else
+static unsigned long probes;
+#endif
+#endif
+#ifdef MM_EVENTS
+static mm_event_t ev_ring[MM_EV_RING];  /* outside the heap, like profs */
+static unsigned long ev_head;           /* events claimed since mm_init */
+static unsigned long ev_tail;           /* events already flushed */
+static unsigned int ev_epoch;           /* mm_init calls */
+static unsigned long long ev_base;      /* PROF_NOW at mm_init ... */
+static unsigned long long ev_base_ns;   /* ... and prof_ns */
+static word_t ev_last[MM_ARENAS][MM_STAT_CLASSES]; /* class counts last recorded */
+static unsigned int ev_threads;         /* threads numbered so far */
+#ifdef MM_THREADS
+static __thread unsigned int ev_thread; /* 1 + this thread's number, 0: none yet */
+static __thread unsigned char ev_flags; /* MM_EV_* flags of the call in progress */
+#else
+static unsigned int ev_thread;
+static unsigned char ev_flags;
+#endif
+#endif
 
 /* Function prototypes for internal helper routines */
+static arena_t *new_arena(int id);
+#ifdef MM_THREADS
+static arena_t *home_arena(void);
+#endif
+static void *alloc_block(size_t size);
+static void *alloc_bytes(size_t bytes);
+static void free_block(void *bp);
+static void release_block(void *bp, size_t size);
+static void merge_block(void *bp);
+static void consolidate(void);
+static void *map_block(size_t size);
+static void *remap_block(void *bp, size_t size);
+static tcache_t *tcache_self(void);
+static void *tcache_get(size_t size, size_t bin);
+static int tcache_put(void *bp, size_t bin);
+static void tcache_drain(tcache_t *t, int bin, int n);
+#ifdef MM_THREADS
+static void tcache_exit(void *p);
+static void tcache_key(void);
+#endif
 static void *extend_heap(size_t bytes);    
+static size_t grow_size(size_t bytes);
 static void *place(void *bp, size_t bytes);
+static void trim_block(void *bp, size_t csize, size_t bytes);
+static int resize_block(void *bp, size_t bytes);
+static void trim_heap(void *bp);
+static void purge_block(void *bp);
+static void purge_range(void *bp, char *lo, char *hi);
+static void purge_sweep(void);
+static void purge_tree(char *node);
+static char *tree_insert(char *root, char *bp);
+static char *tree_delete(char *root, char *bp);
+static char *tree_merge(char *a, char *b);
+static char *tree_fit(size_t bytes);
+#ifdef MM_THREADS
+static void *purge_main(void *unused);
+static void purge_stop(void);
+#endif
 static void *find_fit(size_t bytes);      
 static void *coalesce(void *bp);         
 static inline int  getIndex(size_t size);
+static inline int  tlsfIndex(size_t size);
+static inline int  exactIndex(size_t size);
+static void *exact_find_fit(size_t bytes);
+static char *class_fit(int i, size_t bytes);
+static inline int  nextNonEmpty(int index);
+static void *tlsf_find_fit(size_t bytes);
 static inline void *insertNode(void *bp);
 static inline void deleteNode(void *bp);        
-static inline int getType(void *bp);
+static inline char *aligned_bp(char *bp, size_t align);
+static void *alloc_aligned(size_t bytes, size_t align);
+static size_t alloc_batch(size_t bytes, size_t n, void **out);
+static int addr_cmp(const void *a, const void *b);
+static void *slab_alloc(size_t size);
+static void slab_free(void *p);
+static slab_run *new_run(int cls);
+static int mark_run(void *run, int on);
+static void arena_stats(mm_stats_t *st);
+#ifdef MM_PROFILE
+static void prof_end(prof_scope_t *s);
+#endif
+#if defined(MM_PROFILE) || defined(MM_EVENTS)
+static unsigned long long prof_ns(void);
+#endif
+#ifdef MM_EVENTS
+static void *ev_end(ev_scope_t *s, int op, size_t size, void *p);
+static void ev_counters(void);
+static void ev_counter(int cls, int arena, size_t value);
+#endif
 
 
 
 /**
- * @brief mm_init - Initialize the heap for 84 WSIZE, 
- *      4 to set the foreword, 80 to store the pointer to free_list
+ * @brief mm_init - Initialize the heap: the main arena's metadata
+ *      (see new_arena), then a first free block of CHUNKSIZE bytes
  * @param   {void}  no param
  * @return  {int}   success ->   0
  *                  fail    ->   -1
  */
 int mm_init(void) 
 {
+#ifdef MM_THREADS
+    purge_stop();
+    mem_set_reset_hook(purge_stop);
+#endif
+    /* 决定 arena 布局的选项只在这里生效 */
+    index_mode = index_opt;
+    large_mode = large_opt;
+    slab_max = slab_opt;
+    purge_mode = purge_mode_opt;
+    fast_max = fast_opt;
+    fit_policy = fit_opt;
+    wild_mode = wild_opt;
+    nclasses = (index_mode == INDEX_TLSF) ? TLSF_CLASSES :
+               (index_mode == INDEX_EXACT) ? EXACT_CLASSES : NCLASSES;
+    fast_bins = (fast_max >= BLOCKSIZE) ? FAST_BIN(fast_max) + 1 : 0;
+    heap_lo = mem_heap_lo();
+    run_map = NULL;
+    run_map_pages = 0;
+    tc = NULL;
+    tc_hits = tc_misses = 0;
+#ifdef MM_PROFILE
+    memset(profs, 0, sizeof(profs));
+#endif
+#ifdef MM_EVENTS
+    ev_head = ev_tail = 0;
+    ev_epoch++;
+    ev_base = PROF_NOW();
+    ev_base_ns = prof_ns();
+    memset(ev_last, 0, sizeof(ev_last));
+#endif
+#ifdef MM_THREADS
+    /* run_map 不能在别的线程读的时候搬家, 一次覆盖整个堆 */
+    if (slab_max) {
+        run_map_pages = mem_maxsize() >> RUN_SHIFT;
+        if ((run_map = mem_sbrk(ALIGN(run_map_pages / 8))) == (void *)-1)
+            return -1;
+        memset(run_map, 0, run_map_pages / 8);
+    }
+    memset(arenas, 0, sizeof(arenas));
+    next_arena = 1;
+    heap_gen++;
+#endif
+
     /* Create the initial empty heap */
-    if ((heap_listp = mem_sbrk( 104 * WSIZE)) == (void *)-1) 
+    if ((ar = new_arena(0)) == NULL) 
         return -1;
-    free_head = (size_t *)heap_listp;
-    free_tail = (size_t *)(heap_listp + 50 * WSIZE);
-    int i;
-    for (i = 0; i < 25; ++i){
-        free_head[i] = (size_t)NULL;
-        free_tail[i] = (size_t)NULL;
-    }
-    heap_listp += 100* WSIZE;   
-    PUT(heap_listp, 0);                             /* Alignment padding */
-    PUT(heap_listp + 1 * WSIZE, PACK(DSIZE, 1));    /* Prologue header */ 
-    PUT(heap_listp + 2 * WSIZE, PACK(DSIZE, 1));    /* Prologue footer */ 
-    PUT(heap_listp + 3 * WSIZE, PACK(0, 1));        /* Epilogue header */  
-    heap_listp += 2 * WSIZE;
+    heap_listp = ar->free_lists + nclasses * DSIZE + 2 * WSIZE;
+#ifdef MM_THREADS
+    arenas[0] = home = ar;
+    home_gen = heap_gen;
+#endif
     /* Extend the empty heap with a free block of CHUNKSIZE bytes */
     if (extend_heap(CHUNKSIZE) == NULL) 
         return -1;
+#ifdef MM_THREADS
+    if (purge_threshold && purge_mode == PURGE_THREAD) {
+        purger_stop = 0;
+        purger_on = pthread_create(&purger, NULL, purge_main, NULL) == 0;
+    }
+#endif
     return 0;
 }
 
 /**
- * @brief malloc - Allocate a block with at least size bytes of payload 
- * @param   {size_t}    size
- * @return  {void}      no return
+ * @brief new_arena - Create an arena with its first (empty) segment:
+ *      the arena_t, the slab_partial heads (if slabs are on), the quick
+ *      list heads (if fast_max is set), the rovers (FIT_NEXT), the
+ *      class counters, the sl_bitmap words, nclasses sentinel nodes (DSIZE each), then
+ *      4 WSIZE to set the foreword
+ * @param   {int}       id
+ * @return  {arena_t *} success ->   新 arena
+ *                      fail    ->   NULL
  */
-void *malloc(size_t size) 
+static arena_t *new_arena(int id)
 {
-    size_t bytes, extendsize;      /* Adjusted block size */
-    char *bp;      
-    bytes=size+INFOSIZE;
-    /* Adjust block size to include overhead and alignment reqs. */
-    if (bytes <= BLOCKSIZE)                    
-        bytes = BLOCKSIZE;                                     
-    else
-        bytes = DSIZE * ((bytes + (DSIZE - 1)) / DSIZE); 
-    
-    /* Search the free list for a fit */
-    if ((bp = find_fit(bytes)) != NULL) {
-        bp = place(bp, bytes);
-        return bp;
-    }
+    size_t mapsize = ALIGN(((nclasses + SL_COUNT - 1) >> SL_LOG) * WSIZE);
+    size_t slabsize = slab_max ? SLAB_CLASSES * sizeof(slab_run *) : 0;
+    size_t fastsize = ALIGN(fast_bins * sizeof(char *));
+    size_t roversize = (fit_policy == FIT_NEXT) ? nclasses * sizeof(char *) : 0;
+    size_t statsize = ALIGN(2 * nclasses * sizeof(word_t));
+    arena_t *a;
+    char *p;
+    int i;
 
-    /* No fit found. Get more memory and place the block */
-    extendsize = MAX(bytes, CHUNKSIZE);
-    if ((bp = extend_heap(extendsize)) == NULL) {
-            return NULL;
+    if ((p = mem_sbrk(ALIGN(sizeof(arena_t)) + slabsize + fastsize + roversize + statsize + mapsize +
+                      nclasses * DSIZE + 4 * WSIZE)) == (void *)-1) 
+        return NULL;
+    a = (arena_t *)p;
+    p += ALIGN(sizeof(arena_t));
+    a->id = id;
+    a->slab_partial = (slab_run **)p;
+    memset(a->slab_partial, 0, slabsize);
+    p += slabsize;
+    a->fast = (char **)p;
+    memset(a->fast, 0, fastsize);
+    p += fastsize;
+    a->rover = roversize ? (char **)p : NULL;
+    p += roversize;
+    a->cls_count = (word_t *)p;
+    a->cls_bytes = a->cls_count + nclasses;
+    memset(p, 0, statsize);
+    p += statsize;
+    a->sl_bitmap = (unsigned int *)p;
+    memset(a->sl_bitmap, 0, mapsize);
+    a->fl_bitmap = 0;
+    a->free_lists = p + mapsize;
+    for (i = 0; i < nclasses; ++i){
+        PUT_PRED(a->free_lists + i * DSIZE, a->free_lists + i * DSIZE);
+        PUT_SUCC(a->free_lists + i * DSIZE, a->free_lists + i * DSIZE);
+        if (a->rover)
+            a->rover[i] = a->free_lists + i * DSIZE;
     }
-    place(bp, bytes);
-    return bp;
+    p = a->free_lists + nclasses * DSIZE;
+    PUT(p, 0);                             /* Alignment padding */
+    PUT(p + 1 * WSIZE, PACK(DSIZE, 1));    /* Prologue header */ 
+    PUT(p + 2 * WSIZE, PACK(DSIZE, 1));    /* Prologue footer */ 
+    PUT(p + 3 * WSIZE, PACK(0, 1) | PREV_ALLOC); /* Epilogue header */  
+    a->brk_end = p + 4 * WSIZE;
+    a->tree = NULL;
+    a->frees = 0;
+    a->fast_bytes = 0;
+    a->wild = NULL;
+    a->grow = CHUNKSIZE;
+    a->allocs = a->last_grow = 0;
+    a->free_bytes = a->block_bytes = 0;
+    a->extends = a->splits = 0;
+    memset(a->merges, 0, sizeof(a->merges));
+#ifdef MM_THREADS
+    pthread_mutex_init(&a->lock, NULL);
+#endif
+    return a;
 }
 
+#ifdef MM_THREADS
 /**
- * @brief free - Free a block 
- * @param   {void *}    bp
- * @return  {void}      no return
+ * @brief home_arena - Return the calling thread's arena, binding the
+ *      thread round-robin (and creating the arena) on first use
+ * @param   {void}      no param
+ * @return  {arena_t *} 当前线程的 arena
  */
-void free(void *bp)
+static arena_t *home_arena(void)
 {
-    if(bp == NULL) 
-        return;
-    
-    size_t size = GET_SIZE(HDRP(bp));
-    if (heap_listp == 0){
-        mm_init();
+    if (home == NULL || home_gen != heap_gen) {
+        int id = __atomic_fetch_add(&next_arena, 1, __ATOMIC_RELAXED) % MM_ARENAS;
+        pthread_mutex_lock(&arenas_lock);
+        if (arenas[id] == NULL)
+            arenas[id] = new_arena(id);
+        /* 建不出新 arena 时退回主 arena */
+        home = arenas[id] ? arenas[id] : arenas[0];
+        pthread_mutex_unlock(&arenas_lock);
+        home_gen = heap_gen;
     }
-
-    PUT(HDRP(bp), PACK(size, 0));
-    PUT(FTRP(bp), PACK(size, 0));
-
-    bp = insertNode(bp);
-    coalesce(bp);
+    return home;
 }
+#endif
 
 /**
- * @brief realloc - Give a newSize to an allocted block
- *      (1) if the oldsize is enough to store newsize
- *          ->  simply change the size of oldblock
- *      (2) if the oldsize is not enough to store newsize
- *          ->  memcpy the memory to newPlace
- * @param   {void *}    ptr
- *          {size_t}    size
- * @return  {void}      no return
+ * @brief mm_setopt - Set a run-time option, kept across mm_init calls.
+ *      Options that take effect at the next mm_init are only recorded
+ *      until then; the heap in use keeps the values it was built with
+ *      "list"  ->  "lifo" | "fifo" | "addr"
+ *      "index" ->  "seg" | "tlsf" | "exact" (takes effect at the next mm_init)
+ *      "large" ->  "list" | "tree"     (index of blocks over TREE_MIN; takes
+ *                                       effect at the next mm_init)
+ *      "slab"  ->  0 .. SLAB_MAX       (largest slab request, 0 turns slabs off;
+ *                                       takes effect at the next mm_init)
+ *      "tcache"->  0 .. TCACHE_MAX     (blocks per tcache bin, 0 turns it off)
+ *      "mmap"  ->  bytes               (smallest request given its own region,
+ *                                       0 turns mapping off)
+ *      "trim"  ->  bytes               (free top bytes, beyond a pad of as
+ *                                       many, given back; 0 turns trimming off)
+ *      "purge" ->  bytes               (smallest free block whose pages are
+ *                                       purged, 0 turns purging off)
+ *      "purge_mode" -> "eager" | "batch" | "thread" (MM_THREADS only;
+ *                                       takes effect at the next mm_init)
+ *      "fast"  ->  0 .. FAST_MAX       (largest block, overhead included, whose
+ *                                       coalescing is deferred, 0 turns it off;
+ *                                       takes effect at the next mm_init)
+ *      "fast_limit" -> bytes           (quick-list bytes that force a
+ *                                       consolidation, 0: only when a fit fails)
+ *      "fit"   ->  "first" | "next" | "best" (search within a list; takes
+ *                                       effect at the next mm_init)
+ *      "fit_k" ->  0 .. INT_MAX        (candidates best fit looks at, 0: all)
+ *      "grow"  ->  "fixed" | "adaptive" (heap extension size)
+ *      "grow_budget" -> 0 .. 100       (adaptive slack beyond the request,
+ *                                       % of the heap size)
+ *      "wild"  ->  "off" | "on"        (carve misses from the tail block and
+ *                                       extend by the shortfall; takes effect
+ *                                       at the next mm_init)
+ *      "align" ->  0 | power of two    (malloc requests of at least this
+ *                                       many bytes start on such a boundary,
+ *                                       e.g. 64 for cache lines; 0 turns it off)
+ * @param   {const char *}  name
+ *          {const char *}  value
+ * @return  {int}   success ->   0
+ *                  fail    ->   -1 (unknown name or value)
  */
-void *realloc(void *ptr, size_t size)
+int mm_setopt(const char *name, const char *value)
 {
-    size_t oldsize, bytes;
-    void *newptr;
-    if(size == 0){
-        mm_free(ptr);
-        return NULL;
+    if (!strcmp(name, "list")) {
+        if (!strcmp(value, "lifo"))
+            list_policy = LIST_LIFO;
+        else if (!strcmp(value, "fifo"))
+            list_policy = LIST_FIFO;
+        else if (!strcmp(value, "addr"))
+            list_policy = LIST_ADDR;
+        else
+            return -1;
+        return 0;
     }
-    if(ptr == NULL)
-        return mm_malloc(size);
-    oldsize = THIS_SIZE(ptr);
-    bytes = ALIGN(size + INFOSIZE);
-    if(oldsize >= bytes){
-        PUT(HDRP(ptr), PACK( oldsize, 1));
-        PUT(FTRP(ptr), PACK( oldsize, 1));
-        return ptr;
+    if (!strcmp(name, "index")) {
+        if (!strcmp(value, "seg"))
+            index_opt = INDEX_SEG;
+        else if (!strcmp(value, "tlsf"))
+            index_opt = INDEX_TLSF;
+        else if (!strcmp(value, "exact"))
+            index_opt = INDEX_EXACT;
+        else
+            return -1;
+        return 0;
     }
-    else
-    {
-        newptr = mm_malloc(size);
-        memcpy(newptr, ptr, size);
-        mm_free(ptr);
-        return newptr;
+    if (!strcmp(name, "large")) {
+        if (!strcmp(value, "list"))
+            large_opt = LARGE_LIST;
+        else if (!strcmp(value, "tree"))
+            large_opt = LARGE_TREE;
+        else
+            return -1;
+        return 0;
+    }
+    if (!strcmp(name, "slab")) {
+        char *end;
+        long max = strtol(value, &end, 10);
+        if (*value == '\0' || *end != '\0' || max < 0 || max > SLAB_MAX)
+            return -1;
+        slab_opt = max;
+        return 0;
+    }
+    if (!strcmp(name, "tcache")) {
+        char *end;
+        long cap = strtol(value, &end, 10);
+        if (*value == '\0' || *end != '\0' || cap < 0 || cap > TCACHE_MAX)
+            return -1;
+        tcache_cap = cap;
+        return 0;
+    }
+    if (!strcmp(name, "mmap")) {
+        char *end;
+        long threshold = strtol(value, &end, 10);
+        if (*value == '\0' || *end != '\0' || threshold < 0)
+            return -1;
+        mmap_threshold = threshold;
+        return 0;
+    }
+    if (!strcmp(name, "trim")) {
+        char *end;
+        long threshold = strtol(value, &end, 10);
+        if (*value == '\0' || *end != '\0' || threshold < 0)
+            return -1;
+        trim_threshold = threshold;
+        return 0;
+    }
+    if (!strcmp(name, "purge")) {
+        char *end;
+        long threshold = strtol(value, &end, 10);
+        if (*value == '\0' || *end != '\0' || threshold < 0)
+            return -1;
+        purge_threshold = threshold;
+        return 0;
+    }
+    if (!strcmp(name, "purge_mode")) {
+        if (!strcmp(value, "eager"))
+            purge_mode_opt = PURGE_EAGER;
+        else if (!strcmp(value, "batch"))
+            purge_mode_opt = PURGE_BATCH;
+#ifdef MM_THREADS
+        else if (!strcmp(value, "thread"))
+            purge_mode_opt = PURGE_THREAD;
+#endif
+        else
+            return -1;
+        return 0;
+    }
+    if (!strcmp(name, "fast")) {
+        char *end;
+        long max = strtol(value, &end, 10);
+        if (*value == '\0' || *end != '\0' || max < 0 || max > FAST_MAX)
+            return -1;
+        fast_opt = max;
+        return 0;
+    }
+    if (!strcmp(name, "fast_limit")) {
+        char *end;
+        long limit = strtol(value, &end, 10);
+        if (*value == '\0' || *end != '\0' || limit < 0)
+            return -1;
+        fast_limit = limit;
+        return 0;
+    }
+    if (!strcmp(name, "fit")) {
+        if (!strcmp(value, "first"))
+            fit_opt = FIT_FIRST;
+        else if (!strcmp(value, "next"))
+            fit_opt = FIT_NEXT;
+        else if (!strcmp(value, "best"))
+            fit_opt = FIT_BEST;
+        else
+            return -1;
+        return 0;
+    }
+    if (!strcmp(name, "fit_k")) {
+        char *end;
+        long k = strtol(value, &end, 10);
+        if (*value == '\0' || *end != '\0' || k < 0 || k > INT_MAX)
+            return -1;
+        fit_k = k;
+        return 0;
     }
+    if (!strcmp(name, "grow")) {
+        if (!strcmp(value, "fixed"))
+            grow_mode = GROW_FIXED;
+        else if (!strcmp(value, "adaptive"))
+            grow_mode = GROW_ADAPT;
+        else
+            return -1;
+        return 0;
+    }
+    if (!strcmp(name, "align")) {
+        char *end;
+        long align = strtol(value, &end, 10);
+        if (*value == '\0' || *end != '\0' || align < 0 || (align & (align - 1)))
+            return -1;
+        min_align = align;
+        return 0;
+    }
+    if (!strcmp(name, "wild")) {
+        if (!strcmp(value, "off"))
+            wild_opt = 0;
+        else if (!strcmp(value, "on"))
+            wild_opt = 1;
+        else
+            return -1;
+        return 0;
+    }
+    if (!strcmp(name, "grow_budget")) {
+        char *end;
+        long budget = strtol(value, &end, 10);
+        if (*value == '\0' || *end != '\0' || budget < 0 || budget > 100)
+            return -1;
+        grow_budget = budget;
+        return 0;
+    }
+    return -1;
 }
 
 /**
- * @brief calloc - Allocate the block and set it to zero
- * @param   {size_t}    nmemb
- *          {size_t}    size
- * @return  {void *}    success  ->  已分配块的指针
- *                      fail     ->  NULL
+ * @brief mm_tcache_stats - Report tcache hits and misses since mm_init,
+ *          of drained caches and the calling thread's own
+ * @param   {unsigned long *}   hits
+ *          {unsigned long *}   misses
+ * @return  {void}      no return
  */
-void *calloc (size_t nmemb, size_t size){
-        size_t bytes = nmemb * size;
-        void *newptr;
+void mm_tcache_stats(unsigned long *hits, unsigned long *misses)
+{
+    *hits = tc_hits;
+    *misses = tc_misses;
+#ifdef MM_THREADS
+    if (tc && tc_gen == heap_gen) {
+#else
+    if (tc) {
+#endif
+        *hits += tc->hits;
+        *misses += tc->misses;
+    }
+}
 
-        newptr = malloc(bytes);
-        memset(newptr, 0, bytes);
+/**
+ * @brief mm_get_stats - Report the heap statistics of every arena since
+ *          mm_init. The counters are kept up to date by insertNode,
+ *          deleteNode, trim_block, coalesce and extend_heap, so only the
+ *          classes and the largest class's list are looked at
+ * @param   {mm_stats_t *}  st
+ * @return  {void}      no return
+ */
+void mm_get_stats(mm_stats_t *st)
+{
+#ifdef MM_THREADS
+    arena_t *a;
+    int i;
+#endif
 
-        return newptr;
+    memset(st, 0, sizeof(*st));
+    st->heap_bytes = mem_heapsize();
+    st->mapped_bytes = mem_mapsize();
+    st->nclasses = nclasses;
+    if (heap_listp == NULL)
+        return;
+#ifdef MM_THREADS
+    for (i = 0; i < MM_ARENAS; i++) {
+        pthread_mutex_lock(&arenas_lock);
+        a = arenas[i];
+        pthread_mutex_unlock(&arenas_lock);
+        if (a != NULL) {
+            ENTER(a);
+            arena_stats(st);
+            LEAVE();
+        }
+    }
+#else
+    arena_stats(st);
+#endif
 }
 
 /**
- * @brief mm_checkheap - Print out all of the heap and the free list info.
- * @param   {int}   verbose(no use)
- * @return  {void}  no return
+ * @brief mm_get_profile - Report the phase profile of every arena since
+ *          mm_init (see PROF_PHASE); other threads may still be adding
+ * @param   {mm_profile_t *}    p
+ * @return  {int}   success ->   0
+ *                  fail    ->   -1 (not built with -DMM_PROFILE)
  */
-void mm_checkheap(int verbose) {
-    char* curBp;
-    int i=1;
+int mm_get_profile(mm_profile_t *p)
+{
+    memset(p, 0, sizeof(*p));
+#ifdef MM_PROFILE
+    int a, ph, b;
 
-    /* Checking the free list */
-    printf("free list:\n");
-    for (;i<=19;++i)
-    {
-        printf("size %d\n",i);
-        if (free_head[i]==0){
-            printf("NULL\n");
-            continue;
-        } 
-        for (curBp=(char*)free_head[i];curBp!=(char*)free_tail[i];curBp=GET_SUCC(curBp)){
-            printf("THIS_SIZE :%u , THIS_ALLOC: %d\n",THIS_SIZE(curBp),THIS_ALLOC(curBp));
+    for (a = 0; a < MM_ARENAS; a++) {
+        mm_profile_t *q = &profs[a].p;
+        for (ph = 0; ph < MM_PHASES; ph++) {
+            p->calls[ph] += q->calls[ph];
+            p->cycles[ph] += q->cycles[ph];
+            p->max_cycles[ph] = MAX(p->max_cycles[ph], q->max_cycles[ph]);
+            for (b = 0; b < MM_PROF_BUCKETS; b++) {
+                p->cycle_hist[ph][b] += q->cycle_hist[ph][b];
+                p->probe_hist[ph][b] += q->probe_hist[ph][b];
+            }
         }
-        printf("THIS_SIZE :%u , THIS_ALLOC: %d\n\n",THIS_SIZE(curBp),THIS_ALLOC(curBp));
     }
+    return 0;
+#else
+    return -1;
+#endif
+}
+
+/**
+ * @brief mm_flush_events - Write the events recorded since the last flush
+ *          to f: an mm_event_hdr_t, then the events. At most MM_EV_RING
+ *          fit, older ones are counted as lost. Calls still in progress
+ *          in other threads may leave a slot half written
+ * @param   {FILE *}    f
+ * @return  {long}  success ->   写出的事件数
+ *                  fail    ->   -1 (not built with -DMM_EVENTS, or f failed)
+ */
+long mm_flush_events(FILE *f)
+{
+#ifdef MM_EVENTS
+    mm_event_hdr_t hdr;
+    unsigned long head, tail, first;
+    unsigned long long ns;
 
-    /* Checking the heap */
-    printf("\nheap block:\n");
-    for (curBp=heap_listp;curBp!=mem_heap_hi();curBp=NEXT_BLKP(curBp)){
-        printf("THIS_SIZE :%u , THIS_ALLOC: %d\n\n",THIS_SIZE(curBp),THIS_ALLOC(curBp));
+    ev_counters();
+    head = __atomic_load_n(&ev_head, __ATOMIC_ACQUIRE);
+    tail = ev_tail;
+    memcpy(hdr.magic, "MMEV", 4);
+    hdr.epoch = ev_epoch;
+    hdr.lost = 0;
+    if (head - tail > MM_EV_RING) {
+        hdr.lost = head - tail - MM_EV_RING;
+        tail = head - MM_EV_RING;
     }
+    hdr.count = head - tail;
+    ns = prof_ns() - ev_base_ns;
+    hdr.ticks_per_us = ns ? (PROF_NOW() - ev_base) * 1000.0 / ns : 1000.0;
+    /* 环可能绕回开头, 分两段写 */
+    first = MIN(hdr.count, MM_EV_RING - (tail & (MM_EV_RING - 1)));
+    if (fwrite(&hdr, sizeof(hdr), 1, f) != 1 ||
+        fwrite(&ev_ring[tail & (MM_EV_RING - 1)], sizeof(mm_event_t), first, f) != first ||
+        fwrite(ev_ring, sizeof(mm_event_t), hdr.count - first, f) != hdr.count - first)
+        return -1;
+    ev_tail = head;
+    return hdr.count;
+#else
+    return -1;
+#endif
 }
 
+/**
+ * @brief malloc - Allocate a block with at least size bytes of payload 
+ *          from the calling thread's arena
+ * @param   {size_t}    size
+ * @return  {void}      no return
+ */
+void *malloc(size_t size) 
+{
+    void *bp;
 
-/* Helper Rountines */
+    if (min_align > ALIGNMENT && size >= min_align)
+        return memalign(min_align, size);
+    EV_BEGIN();
+    if (mmap_threshold && size >= mmap_threshold)
+        return EV_RET(MM_EV_MALLOC, size, map_block(size));
+    if (tcache_cap && !(slab_max && size <= slab_max) && MM_BIN(size) < TCACHE_BINS)
+        return EV_RET(MM_EV_MALLOC, size, tcache_get(size, MM_BIN(size)));
+    ENTER(HOME());
+    bp = alloc_block(size);
+    LEAVE();
+    return EV_RET(MM_EV_MALLOC, size, bp);
+}
 
 /**
- * @brief coalesce - Boundary tag coalescing. 
- * @param   {void *}    bp 
- * @return  {void *}    ptr to coalesced block
+ * @brief malloc_fixed - malloc for a size known at compile time. mm.h
+ *          calls it with bytes = MM_BYTES(size) and bin = MM_BIN(size)
+ *          already folded, so only the run-time options are checked
+ * @param   {size_t}    size
+ *          {size_t}    bytes   块大小
+ *          {size_t}    bin     tcache bin
+ * @return  {void *}    success  ->  已分配块的指针
+ *                      fail     ->  NULL
  */
-static void *coalesce(void *bp) 
+void *malloc_fixed(size_t size, size_t bytes, size_t bin)
 {
-    size_t prev_alloc = GET_ALLOC(FTRP(PREV_BLKP(bp)));
-    size_t next_alloc = GET_ALLOC(HDRP(NEXT_BLKP(bp)));
-    size_t size = GET_SIZE(HDRP(bp));
+    void *bp;
 
-    if (prev_alloc && next_alloc) {            /* Case 1 */
-        return bp;
-    }
+    if ((min_align > ALIGNMENT && size >= min_align) ||
+        (mmap_threshold && size >= mmap_threshold) ||
+        (slab_max && size <= slab_max))
+        return malloc(size);
+    EV_BEGIN();
+    if (tcache_cap && bin < TCACHE_BINS)
+        return EV_RET(MM_EV_MALLOC, size, tcache_get(size, bin));
+    ENTER(HOME());
+    ar->allocs++;
+    bp = alloc_bytes(bytes);
+    LEAVE();
+    return EV_RET(MM_EV_MALLOC, size, bp);
+}
 
-    else if (prev_alloc && !next_alloc) {      /* Case 2 */
-        size += GET_SIZE(HDRP(NEXT_BLKP(bp)));
-        deleteNode(NEXT_BLKP(bp));
-        deleteNode(bp);
-        PUT(HDRP(bp), PACK(size, 0));
-        PUT(FTRP(bp), PACK(size,0));
-        insertNode(bp);
+/**
+ * @brief free - Free a block in whichever arena owns it
+ * @param   {void *}    bp
+ * @return  {void}      no return
+ */
+void free(void *bp)
+{
+    if(bp == NULL) 
+        return;
+    if (heap_listp == 0){
+        mm_init();
     }
-
-    else if (!prev_alloc && next_alloc) {      /* Case 3 */
+    EV_BEGIN();
+    if (!IS_RUN(bp) && IS_MAPPED(bp)) {
+        mem_unmap((char *)bp - MAP_HDRSIZE);
+        EV_END(MM_EV_FREE, 0, bp);
+        return;
+    }
+    if (tcache_cap && !IS_RUN(bp) && tcache_put(bp, TC_BIN(GET_SIZE(HDRP(bp))))) {
+        EV_END(MM_EV_FREE, 0, bp);
+        return;
+    }
+
+    ENTER(OWNER(bp));
+    free_block(bp);
+    LEAVE();
+    EV_END(MM_EV_FREE, 0, bp);
+}
+
+/**
+ * @brief free_sized - Free a block whose requested size the caller
+ *          knows. It must be the size last passed to malloc, calloc,
+ *          realloc or memalign for this block; -DDEBUG checks it. The
+ *          block is filed by its real size, which may be larger
+ * @param   {void *}    bp
+ *          {size_t}    size
+ * @return  {void}      no return
+ */
+void free_sized(void *bp, size_t size)
+{
+    size_t bytes;
+
+    if (bp == NULL)
+        return;
+#ifdef DEBUG
+    /* 分配时的块最多多出一个放不下空闲块的尾巴 */
+    assert(size <= malloc_usable_size(bp));
+    assert(IS_RUN(bp) || IS_MAPPED(bp) ||
+           (MM_BYTES(size) <= THIS_SIZE(bp) && THIS_SIZE(bp) < MM_BYTES(size) + BLOCKSIZE));
+#endif
+    /* 映射块和 slab 对象照常释放; mmap 阈值可能在分配后改过, 只信 MAPPED 位 */
+    if (IS_RUN(bp) || IS_MAPPED(bp)) {
+        free(bp);
+        return;
+    }
+    /* bin 和统计按块的实际大小, 可能比 size 对应的大 */
+    bytes = THIS_SIZE(bp);
+    EV_BEGIN();
+    if (tcache_cap && TC_BIN(bytes) < TCACHE_BINS && tcache_put(bp, TC_BIN(bytes))) {
+        EV_END(MM_EV_FREE_SIZED, size, bp);
+        return;
+    }
+    ENTER(OWNER(bp));
+    release_block(bp, bytes);
+    LEAVE();
+    EV_END(MM_EV_FREE_SIZED, size, bp);
+}
+
+/**
+ * @brief malloc_usable_size - Payload bytes of an allocated block, at
+ *          least the size requested; all of them may be used
+ * @param   {void *}    bp
+ * @return  {size_t}    可用字节数, NULL 时为 0
+ */
+size_t malloc_usable_size(void *bp)
+{
+    if (bp == NULL)
+        return 0;
+    if (IS_RUN(bp))
+        return RUN_OF(bp)->size;
+    if (IS_MAPPED(bp))
+        return MAP_LEN(bp) - MAP_HDRSIZE;
+    return THIS_SIZE(bp) - INFOSIZE;
+}
+
+/**
+ * @brief malloc_batch - Allocate n blocks of size bytes each into out.
+ *          Blocks are cut one after another from as few free blocks
+ *          (or heap extensions) as possible; requests that slabs, mmap
+ *          or the align option serve go through malloc one by one
+ * @param   {size_t}    size
+ *          {size_t}    n
+ *          {void **}   out     n 个块指针
+ * @return  {size_t}    分配到的块数, 内存不足时小于 n
+ */
+size_t malloc_batch(size_t size, size_t n, void **out)
+{
+    size_t got = 0, bytes;
+
+    if ((slab_max && size <= slab_max) ||
+        (mmap_threshold && size >= mmap_threshold) ||
+        (min_align > ALIGNMENT && size >= min_align)) {
+        while (got < n && (out[got] = malloc(size)) != NULL)
+            got++;
+        return got;
+    }
+    bytes = MM_BYTES(size);
+    EV_BEGIN();
+    ENTER(HOME());
+    got = alloc_batch(bytes, n, out);
+    LEAVE();
+    EV_END(MM_EV_MALLOC_BATCH, size * got, got ? out[0] : NULL);
+    return got;
+}
+
+/**
+ * @brief free_batch - Free n blocks at once. ptrs is sorted by address
+ *          in place; each run of adjacent heap blocks of one arena
+ *          becomes one block that is freed (and coalesced) once
+ * @param   {void **}   ptrs    可以含 NULL
+ *          {size_t}    n
+ * @return  {void}      no return
+ */
+void free_batch(void **ptrs, size_t n)
+{
+    size_t i = 0, j, csize;
+    char *bp;
+    EV_BEGIN();
+
+    qsort(ptrs, n, sizeof(*ptrs), addr_cmp);
+    while (i < n) {
+        bp = ptrs[i++];
+        /* 映射块和 slab 对象照常释放; 其余不经过 tcache, 与 malloc_batch 一致 */
+        if (bp == NULL || IS_RUN(bp) || IS_MAPPED(bp)) {
+            free(bp);
+            continue;
+        }
+        ENTER(OWNER(bp));
+        csize = THIS_SIZE(bp);
+        for (j = i; j < n && (char *)ptrs[j] == bp + csize; j++)
+            csize += THIS_SIZE(ptrs[j]);
+        if (j > i) {
+            SET_ALLOC(bp, csize);
+            i = j;
+        }
+        release_block(bp, csize);
+        LEAVE();
+    }
+    EV_END(MM_EV_FREE_BATCH, 0, n ? ptrs[0] : NULL);
+}
+
+/**
+ * @brief realloc - Give a newSize to an allocted block
+ *      (1) if the block can be resized in place (see resize_block)
+ *          ->  simply change the size of oldblock
+ *      (2) otherwise
+ *          ->  memcpy the old payload to newPlace
+ * @param   {void *}    ptr
+ *          {size_t}    size
+ * @return  {void}      no return
+ */
+void *realloc(void *ptr, size_t size)
+{
+    size_t oldsize, bytes;
+    void *newptr;
+    int done;
+    if(size == 0){
+        mm_free(ptr);
+        return NULL;
+    }
+    if(ptr == NULL)
+        return mm_malloc(size);
+    EV_BEGIN();
+    if (IS_RUN(ptr)) {
+        oldsize = RUN_OF(ptr)->size;
+        if (size <= oldsize)
+            return EV_RET(MM_EV_REALLOC, size, ptr);
+        if ((newptr = mm_malloc(size)) == NULL)
+            return EV_RET(MM_EV_REALLOC, size, NULL);
+        memcpy(newptr, ptr, oldsize);
+        mm_free(ptr);
+        return EV_RET(MM_EV_REALLOC, size, newptr);
+    }
+    if (IS_MAPPED(ptr))
+        return EV_RET(MM_EV_REALLOC, size, remap_block(ptr, size));
+    bytes = MM_BYTES(size);
+    ENTER(OWNER(ptr));
+    oldsize = THIS_SIZE(ptr);
+    done = resize_block(ptr, bytes);
+    LEAVE();
+    if (done)
+        return EV_RET(MM_EV_REALLOC, size, ptr);
+    if ((newptr = mm_malloc(size)) == NULL)
+        return EV_RET(MM_EV_REALLOC, size, NULL);
+    memcpy(newptr, ptr, oldsize - INFOSIZE);
+    mm_free(ptr);
+    return EV_RET(MM_EV_REALLOC, size, newptr);
+}
+
+/**
+ * @brief calloc - Allocate the block and set it to zero
+ * @param   {size_t}    nmemb
+ *          {size_t}    size
+ * @return  {void *}    success  ->  已分配块的指针
+ *                      fail     ->  NULL
+ */
+void *calloc (size_t nmemb, size_t size){
+        size_t bytes = nmemb * size;
+        void *newptr;
+
+        newptr = malloc(bytes);
+        memset(newptr, 0, bytes);
+
+        return newptr;
+}
+
+/**
+ * @brief memalign - Allocate size bytes whose address is a multiple of
+ *          alignment (a power of two). The padding in front of the block
+ *          stays in the heap as a free block (see alloc_aligned); aligned
+ *          requests are never mapped
+ * @param   {size_t}    alignment
+ *          {size_t}    size
+ * @return  {void *}    success  ->  已分配块的指针
+ *                      fail     ->  NULL (errno EINVAL / ENOMEM)
+ */
+void *memalign(size_t alignment, size_t size)
+{
+    size_t bytes;
+    void *bp;
+
+    if (alignment == 0 || (alignment & (alignment - 1))) {
+        errno = EINVAL;
+        return NULL;
+    }
+    /* 普通块本来就按 ALIGNMENT 对齐 */
+    if (alignment <= ALIGNMENT)
+        return malloc(size);
+    bytes = MM_BYTES(size);
+    EV_BEGIN();
+    ENTER(HOME());
+    bp = alloc_aligned(bytes, alignment);
+    LEAVE();
+    if (bp == NULL)
+        errno = ENOMEM;
+    return EV_RET(MM_EV_MEMALIGN, size, bp);
+}
+
+/**
+ * @brief posix_memalign - memalign that reports errors by return value
+ *          and leaves errno alone; alignment must also be a nonzero
+ *          multiple of sizeof(void *)
+ * @param   {void **}   memptr  成功时存放块指针
+ *          {size_t}    alignment
+ *          {size_t}    size
+ * @return  {int}   success ->   0
+ *                  fail    ->   EINVAL / ENOMEM
+ */
+int posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+    void *bp;
+    int saved = errno;
+
+    if (alignment == 0 || alignment % sizeof(void *) || (alignment & (alignment - 1)))
+        return EINVAL;
+    /* 参数已检查过, memalign 只会因内存不足失败; errno 保持原样 */
+    bp = memalign(alignment, size);
+    errno = saved;
+    if (bp == NULL)
+        return ENOMEM;
+    *memptr = bp;
+    return 0;
+}
+
+/**
+ * @brief aligned_alloc - C11 aligned allocation. Like glibc, size need
+ *          not be a multiple of alignment
+ * @param   {size_t}    alignment
+ *          {size_t}    size
+ * @return  {void *}    success  ->  已分配块的指针
+ *                      fail     ->  NULL
+ */
+void *aligned_alloc(size_t alignment, size_t size)
+{
+    return memalign(alignment, size);
+}
+
+/**
+ * @brief mm_checkheap - Check the free lists' classes and the free block
+ *          counters against a walk of the heap up to its epilogue;
+ *          verbose > 1 also prints every free and heap block
+ * @param   {int}   verbose
+ * @return  {void}  no return
+ */
+void mm_checkheap(int verbose) {
+    char* curBp;
+    unsigned long blocks = 0, counted = 0;
+    size_t bytes = 0;
+    int i;
+
+    /* Checking the free list */
+    if (verbose > 1)
+        printf("free list:\n");
+    for (i = 0; i < nclasses; ++i)
+    {
+        counted += ar->cls_count[i];
+        if (verbose > 1)
+            printf("size %d\n",i);
+        if (GET_SUCC(SENTINEL(i))==SENTINEL(i)){
+            if (verbose > 1)
+                printf("NULL\n");
+            continue;
+        } 
+        for (curBp=GET_SUCC(SENTINEL(i));curBp!=SENTINEL(i);curBp=GET_SUCC(curBp)){
+            if (verbose > 1)
+                printf("THIS_SIZE :%lu , THIS_ALLOC: %d\n",(unsigned long)THIS_SIZE(curBp),(int)THIS_ALLOC(curBp));
+            if (index_mode == INDEX_SEG ?
+                (THIS_SIZE(curBp) > seg_bound[i] ||
+                 (i > 0 && THIS_SIZE(curBp) <= seg_bound[i-1])) :
+                getIndex(THIS_SIZE(curBp)) != i)
+                printf("block %p of %lu bytes not in class %d\n",
+                       curBp, (unsigned long)THIS_SIZE(curBp), i);
+        }
+        if (verbose > 1)
+            printf("\n");
+    }
+
+    /* Checking the heap: 结尾块大小为 0 */
+    if (verbose > 1)
+        printf("\nheap block:\n");
+    for (curBp=heap_listp;THIS_SIZE(curBp)!=0;curBp=NEXT_BLKP(curBp)){
+        if (verbose > 1)
+            printf("THIS_SIZE :%lu , THIS_ALLOC: %d\n\n",(unsigned long)THIS_SIZE(curBp),(int)THIS_ALLOC(curBp));
+        if (!THIS_ALLOC(curBp)) {
+            blocks++;
+            bytes += THIS_SIZE(curBp);
+        }
+    }
+#ifndef MM_THREADS
+    /* 只有一个 arena 时堆是连续的一段 */
+    if (blocks != counted || bytes != ar->free_bytes)
+        printf("%lu free blocks (%lu bytes) in the heap, %lu (%lu bytes) counted\n",
+               blocks, (unsigned long)bytes, counted, (unsigned long)ar->free_bytes);
+#endif
+}
+
+
+/* Helper Rountines */
+
+#ifdef MM_PROFILE
+/**
+ * @brief prof_end - Close the phase s that PROF_PHASE opened: add its
+ *          cycles and probes to the histograms of arena ar
+ * @param   {prof_scope_t *}    s
+ * @return  {void}      no return
+ */
+static void prof_end(prof_scope_t *s)
+{
+    prof_t *pr = &profs[ar->id];
+    unsigned long long c = PROF_NOW() - s->start;
+    unsigned long n = probes - s->probes;
+
+    pr->p.calls[s->phase]++;
+    pr->p.cycles[s->phase] += c;
+    if (c > pr->p.max_cycles[s->phase])
+        pr->p.max_cycles[s->phase] = c;
+    pr->p.cycle_hist[s->phase][PROF_BUCKET(c)]++;
+    pr->p.probe_hist[s->phase][PROF_BUCKET(n)]++;
+}
+#endif
+
+#if defined(MM_PROFILE) || defined(MM_EVENTS)
+/**
+ * @brief prof_ns - PROF_NOW without a time stamp counter: nanoseconds
+ * @param   {void}  no param
+ * @return  {unsigned long long}    单调时钟的纳秒数
+ */
+static unsigned long long prof_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+#endif
+
+#ifdef MM_EVENTS
+/**
+ * @brief ev_end - End the public call s began with one event in the
+ *          ring, and every EV_SAMPLE events record the counters too
+ * @param   {ev_scope_t *}  s
+ *          {int}       op
+ *          {size_t}    size    请求的字节数, 不知道时为 0
+ *          {void *}    p       返回 (或释放) 的块
+ * @return  {void *}    p
+ */
+static void *ev_end(ev_scope_t *s, int op, size_t size, void *p)
+{
+    unsigned long long now = PROF_NOW();
+    unsigned long i = EV_CLAIM();
+    mm_event_t *e = &ev_ring[i & (MM_EV_RING - 1)];
+
+    if (ev_thread == 0)
+        ev_thread = __atomic_add_fetch(&ev_threads, 1, __ATOMIC_RELAXED);
+    e->ts = s->start - ev_base;
+    e->dur = now - s->start;
+    e->size = size;
+    e->addr = (unsigned long)p;
+    e->probes = MIN(probes - s->probes, 65535);
+    e->op = op;
+    e->flags = ev_flags;
+    /* 批量调用的 size 是总字节数, 不对应某个类 */
+    e->cls = (p != NULL && size && op < MM_EV_MALLOC_BATCH) ? getIndex(MM_BYTES(size)) : -1;
+    e->thread = ev_thread - 1;
+    /* 外层调用的标记加上这次的 */
+    ev_flags |= s->flags;
+    if ((i & (EV_SAMPLE - 1)) == 0)
+        ev_counters();
+    return p;
+}
+
+/**
+ * @brief ev_counters - Record the heap size, and the live and free bytes
+ *          and changed class counts of the calling thread's arena. Other
+ *          threads may be changing them (MM_THREADS), so they are a sample
+ * @param   {void}      no param
+ * @return  {void}      no return
+ */
+static void ev_counters(void)
+{
+    arena_t *a;
+    int i;
+
+#ifdef MM_THREADS
+    a = (home != NULL && home_gen == heap_gen) ? home : NULL;
+#else
+    a = ar;
+#endif
+    if (a == NULL || heap_listp == NULL)
+        return;
+    ev_counter(MM_CTR_HEAP, a->id, mem_heapsize() + mem_mapsize());
+    ev_counter(MM_CTR_LIVE, a->id, a->block_bytes - a->free_bytes - a->fast_bytes);
+    ev_counter(MM_CTR_FREE, a->id, a->free_bytes);
+    for (i = 0; i < nclasses; ++i) {
+        if (a->cls_count[i] != ev_last[a->id][i]) {
+            ev_last[a->id][i] = a->cls_count[i];
+            ev_counter(i, a->id, a->cls_count[i]);
+        }
+    }
+}
+
+/**
+ * @brief ev_counter - Record one counter value
+ * @param   {int}       cls     MM_CTR_* 或类号
+ *          {int}       arena
+ *          {size_t}    value
+ * @return  {void}      no return
+ */
+static void ev_counter(int cls, int arena, size_t value)
+{
+    mm_event_t *e = &ev_ring[EV_CLAIM() & (MM_EV_RING - 1)];
+
+    e->ts = PROF_NOW() - ev_base;
+    e->dur = 0;
+    e->size = 0;
+    e->addr = value;
+    e->probes = 0;
+    e->op = MM_EV_COUNTER;
+    e->flags = 0;
+    e->cls = cls;
+    e->thread = arena;
+}
+#endif
+
+/**
+ * @brief arena_stats - Add the counters of arena ar to st
+ * @param   {mm_stats_t *}  st
+ * @return  {void}      no return
+ */
+static void arena_stats(mm_stats_t *st)
+{
+    size_t largest = 0;
+    char *bp;
+    int i, top = -1;
+
+    for (i = 0; i < nclasses; ++i) {
+        if (ar->cls_count[i])
+            top = i;
+        st->class_count[i] += ar->cls_count[i];
+        st->class_bytes[i] += ar->cls_bytes[i];
+    }
+    st->free_bytes += ar->free_bytes;
+    st->cached_bytes += ar->fast_bytes;
+    st->live_bytes += ar->block_bytes - ar->free_bytes - ar->fast_bytes;
+    st->extends += ar->extends;
+    st->splits += ar->splits;
+    for (i = 0; i < 4; ++i)
+        st->coalesces[i] += ar->merges[i];
+
+    /* 最大的空闲块属于最高的非空类: 在它的链表里, 树的最右端或 wilderness */
+    if (ar->wild)
+        largest = THIS_SIZE(ar->wild);
+    for (bp = ar->tree; bp != NULL; bp = GET_RIGHT(bp))
+        largest = MAX(largest, THIS_SIZE(bp));
+    if (top >= 0)
+        for (bp = GET_SUCC(SENTINEL(top)); bp != SENTINEL(top); bp = GET_SUCC(bp))
+            largest = MAX(largest, THIS_SIZE(bp));
+    st->largest_free = MAX(st->largest_free, largest);
+}
+
+/**
+ * @brief map_block - Allocate size bytes in a region of their own
+ * @param   {size_t}    size
+ * @return  {void *}    success  ->  已分配块的指针
+ *                      fail     ->  NULL
+ */
+static void *map_block(size_t size)
+{
+    size_t pagesize = mem_pagesize();
+    size_t len = (size + MAP_HDRSIZE + pagesize - 1) & ~(pagesize - 1);
+    char *bp;
+
+    if ((bp = mem_map(len)) == NULL)
+        return NULL;
+    bp += MAP_HDRSIZE;
+    MAP_LEN(bp) = len;
+    PUT(HDRP(bp), PACK(0, 1) | MAPPED);
+    return bp;
+}
+
+/**
+ * @brief remap_block - Resize a mapped block: remap its region while the
+ *          size stays at or above mmap_threshold, else move it to the
+ *          heap (which may also grow it, if the threshold was raised or
+ *          turned off since it was mapped)
+ * @param   {void *}    bp
+ *          {size_t}    size
+ * @return  {void *}    success  ->  新的块指针
+ *                      fail     ->  NULL (原块不变)
+ */
+static void *remap_block(void *bp, size_t size)
+{
+    size_t pagesize = mem_pagesize();
+    size_t len = (size + MAP_HDRSIZE + pagesize - 1) & ~(pagesize - 1);
+    char *p, *newptr;
+
+    if (mmap_threshold && size >= mmap_threshold) {
+        if (len == MAP_LEN(bp))
+            return bp;
+        if ((p = mem_remap((char *)bp - MAP_HDRSIZE, len)) == NULL)
+            return NULL;
+        bp = p + MAP_HDRSIZE;
+        MAP_LEN(bp) = len;
+        return bp;
+    }
+    if ((newptr = mm_malloc(size)) == NULL)
+        return NULL;
+    /* mmap 阈值可能已被调低或关掉, 变大的块也会走到这里 */
+    memcpy(newptr, bp, MIN(size, MAP_LEN(bp) - MAP_HDRSIZE));
+    mem_unmap((char *)bp - MAP_HDRSIZE);
+    return newptr;
+}
+
+/**
+ * @brief tcache_self - Return the calling thread's cache, making it
+ *          (a block of the home arena) on first use
+ * @param   {void}      no param
+ * @return  {tcache_t *}    success ->  当前线程的 tcache
+ *                          fail    ->  NULL
+ */
+static tcache_t *tcache_self(void)
+{
+#ifdef MM_THREADS
+    if (tc != NULL && tc_gen == heap_gen)
+        return tc;
+#else
+    if (tc != NULL)
+        return tc;
+#endif
+    ENTER(HOME());
+    tc = alloc_block(sizeof(tcache_t));
+    LEAVE();
+    if (tc == NULL)
+        return NULL;
+    memset(tc, 0, sizeof(tcache_t));
+#ifdef MM_THREADS
+    tc_gen = heap_gen;
+    pthread_once(&tc_once, tcache_key);
+    pthread_setspecific(tc_key, tc);
+#endif
+    return tc;
+}
+
+/**
+ * @brief tcache_get - Allocate a block of bin's size from the tcache;
+ *          on a miss take a batch of half a bin from the home arena,
+ *          which counts as one allocation of the arena
+ * @param   {size_t}    size
+ *          {size_t}    bin
+ * @return  {void *}    success  ->  已分配块的指针
+ *                      fail     ->  NULL
+ */
+static void *tcache_get(size_t size, size_t bin)
+{
+    tcache_t *t = tcache_self();
+    char *bp, *extra;
+    int n;
+
+    if (t != NULL && (bp = t->bins[bin]) != NULL) {
+        t->bins[bin] = *(char **)bp;
+        t->counts[bin]--;
+        t->hits++;
+        return bp;
+    }
+    ENTER(HOME());
+    bp = alloc_block(size);
+    if (t != NULL) {
+        t->misses++;
+        /* 同一批里不拆分剩余部分的块可能属于别的 bin; 整批只算一次分配 */
+        for (n = (tcache_cap - 1) / 2; bp && n > 0; n--) {
+            size_t b;
+            if ((extra = alloc_bytes(MM_BYTES(size))) == NULL)
+                break;
+            b = TC_BIN(GET_SIZE(HDRP(extra)));
+            if (b >= TCACHE_BINS || t->counts[b] >= tcache_cap) {
+                free_block(extra);
+                break;
+            }
+            *(char **)extra = t->bins[b];
+            t->bins[b] = extra;
+            t->counts[b]++;
+        }
+    }
+    LEAVE();
+    return bp;
+}
+
+/**
+ * @brief tcache_put - Keep a freed block in tcache bin bin, first giving
+ *          half of a full bin back to the arenas
+ * @param   {void *}    bp
+ *          {size_t}    bin
+ * @return  {int}       1 -> 已放入 tcache
+ *                      0 -> 块太大或没有 tcache, 需正常释放
+ */
+static int tcache_put(void *bp, size_t bin)
+{
+    tcache_t *t;
+
+    if (bin >= TCACHE_BINS || (t = tcache_self()) == NULL)
+        return 0;
+    if (t->counts[bin] >= tcache_cap)
+        tcache_drain(t, bin, (tcache_cap + 1) / 2);
+    *(char **)bp = t->bins[bin];
+    t->bins[bin] = bp;
+    t->counts[bin]++;
+    return 1;
+}
+
+/**
+ * @brief tcache_drain - Free up to n blocks of a bin into their arenas,
+ *          locking each arena once per run of blocks it owns
+ * @param   {tcache_t *}    t
+ *          {int}           bin
+ *          {int}           n
+ * @return  {void}      no return
+ */
+static void tcache_drain(tcache_t *t, int bin, int n)
+{
+    char *bp;
+#ifdef MM_THREADS
+    arena_t *locked = NULL, *owner;
+#endif
+
+    while (n-- > 0 && (bp = t->bins[bin]) != NULL) {
+        t->bins[bin] = *(char **)bp;
+        t->counts[bin]--;
+#ifdef MM_THREADS
+        if ((owner = OWNER(bp)) != locked) {
+            if (locked)
+                LEAVE();
+            ENTER(locked = owner);
+        }
+#endif
+        free_block(bp);
+    }
+#ifdef MM_THREADS
+    if (locked)
+        LEAVE();
+#endif
+}
+
+#ifdef MM_THREADS
+/**
+ * @brief tcache_exit - Thread-exit destructor: give every cached block
+ *          and the cache itself back, keeping its counts
+ * @param   {void *}    p
+ * @return  {void}      no return
+ */
+static void tcache_exit(void *p)
+{
+    int bin;
+
+    if (p != tc || tc_gen != heap_gen)
+        return;
+    for (bin = 0; bin < TCACHE_BINS; bin++)
+        tcache_drain(tc, bin, TCACHE_MAX);
+    __atomic_add_fetch(&tc_hits, tc->hits, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&tc_misses, tc->misses, __ATOMIC_RELAXED);
+    ENTER(OWNER(tc));
+    free_block(tc);
+    LEAVE();
+    tc = NULL;
+}
+
+/**
+ * @brief tcache_key - Create the key whose destructor is tcache_exit
+ * @param   {void}      no param
+ * @return  {void}      no return
+ */
+static void tcache_key(void)
+{
+    pthread_key_create(&tc_key, tcache_exit);
+}
+#endif
+
+/**
+ * @brief alloc_block - Allocate size bytes of payload from arena ar
+ * @param   {size_t}    size
+ * @return  {void *}    success  ->  已分配块的指针
+ *                      fail     ->  NULL
+ */
+static void *alloc_block(size_t size)
+{
+    ar->allocs++;
+    if (slab_max && size <= slab_max)
+        return slab_alloc(size);
+    /* Adjust block size to include overhead and alignment reqs. */
+    return alloc_bytes(MM_BYTES(size));
+}
+
+/**
+ * @brief alloc_bytes - Allocate a heap block of bytes bytes (already
+ *          rounded) from arena ar
+ * @param   {size_t}    bytes
+ * @return  {void *}    success  ->  已分配块的指针
+ *                      fail     ->  NULL
+ */
+static void *alloc_bytes(size_t bytes)
+{
+    size_t extendsize;
+    char *bp;
+
+    /* 同样大小的块刚刚释放过, 直接取走 */
+    if (FAST_BIN(bytes) < fast_bins && (bp = ar->fast[FAST_BIN(bytes)]) != NULL) {
+        ar->fast[FAST_BIN(bytes)] = *(char **)bp;
+        ar->fast_bytes -= bytes;
+        return bp;
+    }
+
+    /* Search the free list for a fit */
+    if ((bp = find_fit(bytes)) == NULL && ar->fast_bytes) {
+        consolidate();
+        bp = find_fit(bytes);
+    }
+    /* 从堆尾切: place 对 wilderness 只改头尾 */
+    if (bp == NULL && ar->wild && THIS_SIZE(ar->wild) >= bytes)
+        bp = ar->wild;
+    if (bp != NULL) {
+        bp = place(bp, bytes);
+        return bp;
+    }
+
+    /* No fit found. Get more memory and place the block; the wilderness
+     * already covers part of it */
+    extendsize = grow_size(bytes);
+    if (ar->wild)
+        extendsize = MAX(extendsize - THIS_SIZE(ar->wild), BLOCKSIZE);
+    if ((bp = extend_heap(extendsize)) == NULL) {
+            return NULL;
+    }
+    /* 别的 arena 抢先扩展过时新段不与 wilderness 相连 */
+    if (THIS_SIZE(bp) < bytes && (bp = extend_heap(grow_size(bytes))) == NULL)
+        return NULL;
+    place(bp, bytes);
+    return bp;
+}
+
+/**
+ * @brief free_block - Free a block (or slab object) owned by arena ar
+ * @param   {void *}    bp
+ * @return  {void}      no return
+ */
+static void free_block(void *bp)
+{
+    if (IS_RUN(bp)) {
+        slab_free(bp);
+        return;
+    }
+
+    release_block(bp, GET_SIZE(HDRP(bp)));
+}
+
+/**
+ * @brief release_block - Free heap block bp of size bytes: keep it in
+ *          its quick list, or merge it right away (see merge_block)
+ * @param   {void *}    bp
+ *          {size_t}    size
+ * @return  {void}      no return
+ */
+static void release_block(void *bp, size_t size)
+{
+    if (FAST_BIN(size) < fast_bins) {
+        *(char **)bp = ar->fast[FAST_BIN(size)];
+        ar->fast[FAST_BIN(size)] = bp;
+        if ((ar->fast_bytes += size) > fast_limit && fast_limit)
+            consolidate();
+        return;
+    }
+    merge_block(bp);
+}
+
+/**
+ * @brief merge_block - Really free a block: mark it free, coalesce it
+ *          with its neighbours, then trim or purge what came out
+ * @param   {void *}    bp
+ * @return  {void}      no return
+ */
+static void merge_block(void *bp)
+{
+    size_t size = GET_SIZE(HDRP(bp));
+    /* 自己, 加上前块的尾部和后块的头部与链接 */
+    char *lo = (char *)bp - DSIZE, *hi = (char *)bp + size + DSIZE;
+    int dirty_prev = 0, dirty_next = 0;
+
+    SET_FREE(bp, size);
+    CLR_PREV_ALLOC(NEXT_BLKP(bp));
+
+    /* eager 时只清没清过的部分: 合并进来的 PURGED 邻居已经清过 */
+    if (purge_threshold && purge_mode == PURGE_EAGER) {
+        dirty_prev = !PREV_ALLOCED(bp) && !(GET(HDRP(PREV_BLKP(bp))) & PURGED);
+        dirty_next = !GET_ALLOC(HDRP(NEXT_BLKP(bp))) && !(GET(HDRP(NEXT_BLKP(bp))) & PURGED);
+    }
+    bp = insertNode(bp);
+    bp = coalesce(bp);
+    if (trim_threshold)
+        trim_heap(bp);
+    if (purge_threshold) {
+        if (purge_mode == PURGE_EAGER && THIS_SIZE(bp) >= purge_threshold)
+            purge_range(bp, dirty_prev ? (char *)bp : lo, dirty_next ? FTRP(bp) : hi);
+        else if (purge_mode == PURGE_BATCH && ++ar->frees >= PURGE_EVERY) {
+            ar->frees = 0;
+            purge_sweep();
+        }
+    }
+}
+
+/**
+ * @brief consolidate - Empty every quick list of arena ar through
+ *          merge_block, so that the deferred frees coalesce
+ * @return  {void}      no return
+ */
+static void consolidate(void)
+{
+    char *bp, *next;
+    size_t b;
+
+    for (b = 0; b < fast_bins; ++b) {
+        for (bp = ar->fast[b]; bp != NULL; bp = next) {
+            next = *(char **)bp;
+            merge_block(bp);
+        }
+        ar->fast[b] = NULL;
+    }
+    ar->fast_bytes = 0;
+}
+
+/**
+ * @brief coalesce - Boundary tag coalescing. 
+ * @param   {void *}    bp 
+ * @return  {void *}    ptr to coalesced block
+ */
+static void *coalesce(void *bp) 
+{
+    PROF_PHASE(MM_PHASE_COALESCE);
+    size_t prev_alloc = PREV_ALLOCED(bp);
+    size_t next_alloc = GET_ALLOC(HDRP(NEXT_BLKP(bp)));
+    size_t size = GET_SIZE(HDRP(bp));
+
+    if (prev_alloc && next_alloc) {            /* Case 1 */
+        ar->merges[0]++;
+        return bp;
+    }
+
+    else if (prev_alloc && !next_alloc) {      /* Case 2 */
+        ar->merges[1]++;
+        EV_FLAG(MM_EV_COALESCE);
+        size += GET_SIZE(HDRP(NEXT_BLKP(bp)));
+        deleteNode(NEXT_BLKP(bp));
+        deleteNode(bp);
+        SET_FREE(bp, size);
+        insertNode(bp);
+    }
+
+    else if (!prev_alloc && next_alloc) {      /* Case 3 */
+        ar->merges[2]++;
+        EV_FLAG(MM_EV_COALESCE);
         size += GET_SIZE(HDRP(PREV_BLKP(bp)));
         deleteNode(PREV_BLKP(bp));
         deleteNode(bp);
-        PUT(FTRP(bp), PACK(size, 0));
-        PUT(HDRP(PREV_BLKP(bp)), PACK(size, 0));
         bp = PREV_BLKP(bp);
+        SET_FREE(bp, size);
         insertNode(bp);
     }
 
     else {                                     /* Case 4 */
+        ar->merges[3]++;
+        EV_FLAG(MM_EV_COALESCE);
         size += GET_SIZE(HDRP(PREV_BLKP(bp))) + 
             GET_SIZE(FTRP(NEXT_BLKP(bp)));
         deleteNode(bp);
         deleteNode(NEXT_BLKP(bp));
         deleteNode(PREV_BLKP(bp));
-        PUT(HDRP(PREV_BLKP(bp)), PACK(size, 0));
-        PUT(FTRP(NEXT_BLKP(bp)), PACK(size, 0));
         bp = PREV_BLKP(bp);
+        SET_FREE(bp, size);
         insertNode(bp);
     }
-    return bp;
+    return bp;
+}
+
+/**
+ * @brief place - Place block of asize bytes at start of free block bp 
+ *          and split if remainder would be at least minimum block size
+ * @param   {void *}    bp
+ *          {size_t}    bytes
+ * @return  {void *}    原指针
+ */
+static void* place(void *bp, size_t bytes)
+{
+    deleteNode(bp);
+    trim_block(bp, THIS_SIZE(bp), bytes);
+    return bp;
+}
+
+/**
+ * @brief trim_block - Mark the csize bytes at bp (in no list) allocated,
+ *          splitting off a free block if the remainder would be at
+ *          least minimum block size. The block after bp must be allocated
+ * @param   {void *}    bp
+ *          {size_t}    csize
+ *          {size_t}    bytes
+ * @return  {void}      no return
+ */
+static void trim_block(void *bp, size_t csize, size_t bytes)
+{
+    if ((csize - bytes) >= BLOCKSIZE) { 
+        ar->splits++;
+        EV_FLAG(MM_EV_SPLIT);
+        SET_ALLOC(bp, bytes);
+        void*nextBp= NEXT_BLKP(bp);
+        PUT(HDRP(nextBp), PACK(csize-bytes, 0) | PREV_ALLOC);
+        PUT(FTRP(nextBp), PACK(csize-bytes, 0));
+        CLR_PREV_ALLOC(NEXT_BLKP(nextBp));
+        insertNode(nextBp);
+    }
+    else { 
+        SET_ALLOC(bp, csize);
+        SET_PREV_ALLOC(NEXT_BLKP(bp));
+    }
+}
+
+/**
+ * @brief resize_block - Resize an allocated block in place: absorb a
+ *          free next block, extend the heap by the shortfall when the
+ *          block (or that free block) is the arena's last, and split
+ *          off whatever is left over
+ * @param   {void *}    bp
+ *          {size_t}    bytes   新的块大小 (已对齐)
+ * @return  {int}   success ->   1
+ *                  fail    ->   0 (只能搬到别处)
+ */
+static int resize_block(void *bp, size_t bytes)
+{
+    char *next = NEXT_BLKP(bp);
+    size_t csize = THIS_SIZE(bp);
+
+    if (!GET_ALLOC(HDRP(next)))
+        csize += THIS_SIZE(next);
+    if (csize < bytes) {
+        char *last = GET_ALLOC(HDRP(next)) ? next : NEXT_BLKP(next);
+        char *ext;
+        /* 新块要紧接在 last 处 (别的 arena 可能抢先扩展了堆);
+         * wild_mode 下 extend_heap 已把它并进 wilderness next */
+        if (last != ar->brk_end ||
+            (ext = extend_heap(MAX(bytes - csize, BLOCKSIZE))) == NULL)
+            return 0;
+        if (ext == last)
+            coalesce(last);
+        else if (ext != next)
+            return 0;
+        next = NEXT_BLKP(bp);
+        csize = THIS_SIZE(bp) + THIS_SIZE(next);
+    }
+    if (!GET_ALLOC(HDRP(next)))
+        deleteNode(next);
+    trim_block(bp, csize, bytes);
+    return 1;
+}
+
+/**
+ * @brief find_fit - Find a fit for a block with asize bytes, 
+ *            using first fit method, by getIndex function
+ * @param   {size_t}    bytes
+ * @return  {void *}    success  ->  找到的合适位置
+ *                      fail     ->  NULL
+ */
+static void* find_fit(size_t bytes)
+{
+    PROF_PHASE(MM_PHASE_FIT);
+    if (IS_TREE(bytes))
+        return tree_fit(bytes);
+    if (index_mode != INDEX_SEG) {
+        char *bp = (index_mode == INDEX_TLSF) ? tlsf_find_fit(bytes) : exact_find_fit(bytes);
+        return (bp == NULL && large_mode == LARGE_TREE) ? tree_fit(bytes) : bp;
+    }
+
+    char *curBp;
+    int i;
+    /* 位图跳过空链表 */
+    for (i = nextNonEmpty(getIndex(bytes)); i >= 0;
+         i = (i + 1 < NCLASSES) ? nextNonEmpty(i + 1) : -1)
+    {
+        if ((curBp = class_fit(i, bytes)) != NULL)
+            return curBp;
+    }
+    return (large_mode == LARGE_TREE) ? tree_fit(bytes) : NULL;
+}
+
+/**
+ * @brief class_fit - Search list i for a block of at least bytes by
+ *          fit_policy
+ * @param   {int}       i
+ *          {size_t}    bytes
+ * @return  {char *}    success  ->  找到的块
+ *                      fail     ->  NULL
+ */
+static char *class_fit(int i, size_t bytes)
+{
+    char *sent = SENTINEL(i), *bp, *start, *best = NULL;
+    int seen = 0;
+
+    switch (fit_policy)
+    {
+        case FIT_NEXT:
+            /* 从游标绕链表一圈, 跳过哨兵 */
+            bp = start = ar->rover[i];
+            do {
+                PROF_PROBE();
+                if (bp != sent && THIS_SIZE(bp) >= bytes) {
+                    ar->rover[i] = GET_SUCC(bp);
+                    return bp;
+                }
+                bp = GET_SUCC(bp);
+            } while (bp != start);
+            return NULL;
+        case FIT_BEST:
+            for (bp = GET_SUCC(sent); bp != sent; bp = GET_SUCC(bp)) {
+                PROF_PROBE();
+                if (THIS_SIZE(bp) < bytes)
+                    continue;
+                if (best == NULL || THIS_SIZE(bp) < THIS_SIZE(best))
+                    best = bp;
+                if (THIS_SIZE(bp) == bytes || ++seen == fit_k)
+                    break;
+            }
+            return best;
+        default:
+            for (bp = GET_SUCC(sent); bp != sent; bp = GET_SUCC(bp)) {
+                PROF_PROBE();
+                if (THIS_SIZE(bp) >= bytes)
+                    return bp;
+            }
+            return NULL;
+    }
+}
+
+/**
+ * @brief tree_fit - Best fit among the tree's blocks: the smallest
+ *          block of at least bytes, the lowest address among equals
+ * @param   {size_t}    bytes
+ * @return  {char *}    success  ->  找到的块
+ *                      fail     ->  NULL
+ */
+static char *tree_fit(size_t bytes)
+{
+    char *node = ar->tree, *best = NULL;
+
+    while (node != NULL) {
+        PROF_PROBE();
+        if (THIS_SIZE(node) >= bytes) {
+            best = node;
+            node = GET_LEFT(node);
+        }
+        else
+            node = GET_RIGHT(node);
+    }
+    return best;
+}
+
+/**
+ * @brief tree_insert - Insert bp into the treap under root, rotating it
+ *          up while its priority beats its parent's
+ * @param   {char *}    root
+ *          {char *}    bp
+ * @return  {char *}    新的根
+ */
+static char *tree_insert(char *root, char *bp)
+{
+    char *child;
+
+    if (root == NULL) {
+        PUT_LEFT(bp, NULL);
+        PUT_RIGHT(bp, NULL);
+        return bp;
+    }
+    PROF_PROBE();
+    if (TREE_LESS(bp, root)) {
+        child = tree_insert(GET_LEFT(root), bp);
+        if (PRIORITY(child) > PRIORITY(root)) {     /* 右旋 */
+            PUT_LEFT(root, GET_RIGHT(child));
+            PUT_RIGHT(child, root);
+            return child;
+        }
+        PUT_LEFT(root, child);
+    }
+    else {
+        child = tree_insert(GET_RIGHT(root), bp);
+        if (PRIORITY(child) > PRIORITY(root)) {     /* 左旋 */
+            PUT_RIGHT(root, GET_LEFT(child));
+            PUT_LEFT(child, root);
+            return child;
+        }
+        PUT_RIGHT(root, child);
+    }
+    return root;
+}
+
+/**
+ * @brief tree_delete - Remove bp from the treap under root; bp's size
+ *          must still be the one it was inserted with
+ * @param   {char *}    root
+ *          {char *}    bp
+ * @return  {char *}    新的根
+ */
+static char *tree_delete(char *root, char *bp)
+{
+    char *child;
+
+    if (root == bp)
+        return tree_merge(GET_LEFT(bp), GET_RIGHT(bp));
+    /* PUT_LEFT/PUT_RIGHT 会对参数求值两次, 先存下递归的结果 */
+    if (TREE_LESS(bp, root)) {
+        child = tree_delete(GET_LEFT(root), bp);
+        PUT_LEFT(root, child);
+    }
+    else {
+        child = tree_delete(GET_RIGHT(root), bp);
+        PUT_RIGHT(root, child);
+    }
+    return root;
+}
+
+/**
+ * @brief tree_merge - Join two treaps, every key of a below every key of b
+ * @param   {char *}    a
+ *          {char *}    b
+ * @return  {char *}    合并后的根
+ */
+static char *tree_merge(char *a, char *b)
+{
+    char *child;
+
+    if (a == NULL)
+        return b;
+    if (b == NULL)
+        return a;
+    if (PRIORITY(a) > PRIORITY(b)) {
+        child = tree_merge(GET_RIGHT(a), b);
+        PUT_RIGHT(a, child);
+        return a;
+    }
+    child = tree_merge(a, GET_LEFT(b));
+    PUT_LEFT(b, child);
+    return b;
 }
 
 /**
- * @brief place - Place block of asize bytes at start of free block bp 
- *          and split if remainder would be at least minimum block size
- * @param   {void *}    bp
- *          {size_t}    bytes
- * @return  {void *}    原指针
+ * @brief tlsf_find_fit - Good fit in O(1): round bytes up to the next
+ *          second-level class so that any block of the first non-empty
+ *          class found in the bitmaps fits, and take its head
+ * @param   {size_t}    bytes
+ * @return  {void *}    success  ->  找到的合适位置
+ *                      fail     ->  NULL
  */
-static void* place(void *bp, size_t bytes)
+static void *tlsf_find_fit(size_t bytes)
 {
-    size_t csize = THIS_SIZE(bp);   
-    deleteNode(bp);
-    if ((csize - bytes) >= BLOCKSIZE) { 
-        PUT(HDRP(bp), PACK(bytes, 1));
-        PUT(FTRP(bp), PACK(bytes, 1));
-        void*nextBp= NEXT_BLKP(bp);
-        PUT(HDRP(nextBp), PACK(csize-bytes, 0));
-        PUT(FTRP(nextBp), PACK(csize-bytes, 0));
-        insertNode(nextBp);
-    }
-    else { 
-        PUT(HDRP(bp), PACK(csize, 1));
-        PUT(FTRP(bp), PACK(csize, 1));
-    }
-    return bp;
+    size_t rounded = bytes;
+    char *bp;
+    int i;
+
+    if (bytes >= (1 << FL_SHIFT))
+        rounded += ((size_t)1 << (63 - __builtin_clzll(bytes) - SL_LOG)) - 1;
+    if ((i = nextNonEmpty(tlsfIndex(rounded))) >= 0)
+        return GET_SUCC(SENTINEL(i));
+
+    /* 上取整后没有可用块, 本类表头可能仍然够大 */
+    i = tlsfIndex(bytes);
+    bp = GET_SUCC(SENTINEL(i));
+    if (bp != SENTINEL(i) && THIS_SIZE(bp) >= bytes)
+        return bp;
+    return NULL;
 }
 
 /**
- * @brief find_fit - Find a fit for a block with asize bytes, 
- *            using first fit method, by getIndex function
+ * @brief exact_find_fit - Every block in a bin at or above bytes's own
+ *          fits, so a small request takes the head of the first non-empty
+ *          one; a larger request scans its own class first
  * @param   {size_t}    bytes
  * @return  {void *}    success  ->  找到的合适位置
  *                      fail     ->  NULL
  */
-static void* find_fit(size_t bytes)
+static void *exact_find_fit(size_t bytes)
 {
-    void *curBp;
-    int i=getIndex(bytes);
-    for (;i<=19;++i)
-    {
-        if ((void*)free_head[i]==NULL)
-            continue;
-        for (curBp=(char *)free_head[i];curBp!=(void*)free_tail[i];curBp=GET_SUCC(curBp)){
-            if (THIS_SIZE(curBp)>=bytes)
-                return curBp;
-        }
-        if (THIS_SIZE(curBp)>=bytes)
-            return curBp;
+    char *bp;
+    int i = exactIndex(bytes);
+
+    if (bytes > EXACT_MAX) {
+        if ((bp = class_fit(i, bytes)) != NULL)
+            return bp;
+        if (++i >= nclasses)
+            return NULL;
     }
+    if ((i = nextNonEmpty(i)) >= 0)
+        return GET_SUCC(SENTINEL(i));
     return NULL;
 }
 
 /**
- * @brief insertNode - Insert a block to the list,
- *          以地址顺序维护链表, 每个块的地址都小于其后继的地址
- * @param   {void *}    bp
- * @return  {void *}    bp
+ * @brief nextNonEmpty - Find the first non-empty list at or above index
+ *          with two bit scans over fl_bitmap and sl_bitmap
+ * @param   {int}   index
+ * @return  {int}   success  ->  非空链表的序号
+ *                      fail     ->  -1
  */
-static inline void* insertNode(void* bp)
+static inline int nextNonEmpty(int index)
 {
-    int index = getIndex(THIS_SIZE(bp));
-    char *curBp = (char *)free_head[index];
+    int fl = index >> SL_LOG;
+    unsigned int map = ar->sl_bitmap[fl] & (~0U << (index & (SL_COUNT - 1)));
 
-    if ((void*)free_head[index]==NULL)
-        free_head[index]=free_tail[index]=(size_t)bp;
-    else{
-        if (free_head[index]>(size_t)bp){
-            PUT_SUCC(bp,free_head[index]);
-            PUT_PRED(free_head[index],bp);
-            free_head[index]=(size_t)bp;
-        }
-        else if (free_tail[index]<(size_t)bp){
-            PUT_SUCC(free_tail[index],bp);
-            PUT_PRED(bp,free_tail[index]);
-            free_tail[index]=(size_t)bp;
-        }
-        else{
-            while (GET_SUCC(curBp)<(char*)bp){
-                curBp=GET_SUCC(curBp);
-            }
-            char* nextBp=GET_SUCC(curBp);
-            PUT_PRED(nextBp,bp);
-            PUT_SUCC(curBp,bp);
-            PUT_SUCC(bp,nextBp);
-            PUT_PRED(bp,curBp);
-        }
+    if (!map) {
+        unsigned int flmap = (fl + 1 < FL_MAX) ? ar->fl_bitmap & (~0U << (fl + 1)) : 0;
+        if (!flmap)
+            return -1;
+        fl = __builtin_ctz(flmap);
+        map = ar->sl_bitmap[fl];
     }
-
-    return bp;
+    return (fl << SL_LOG) + __builtin_ctz(map);
 }
 
 /**
- * @brief getType - Return a node's type
+ * @brief insertNode - Insert a block to the list by list_policy
+ *          LIFO:   插入哨兵之后 (表头)
+ *          FIFO:   插入哨兵之前 (表尾)
+ *          ADDR:   以地址顺序维护链表, 每个块的地址都小于其后继的地址
  * @param   {void *}    bp
- * @return  {int}   四种预定义类型
+ * @return  {void *}    bp
  */
-static inline int getType(void *bp)
+static inline void* insertNode(void* bp)
 {
-    int index=getIndex(THIS_SIZE(bp));
-    if (free_head[index]==free_tail[index])
-        return ALLNULL;
-    else if (free_head[index]==(size_t)(bp))
-        return HEADNULL;
-    else if (free_tail[index]==(size_t)(bp))
-        return TAILNULL;
-    else
-        return NORMAL;
+    PROF_PHASE(MM_PHASE_INSERT);
+    size_t size = THIS_SIZE(bp);
+    int index = getIndex(size);
+
+    ar->cls_count[index]++;
+    ar->cls_bytes[index] += size;
+    ar->free_bytes += size;
+    if (wild_mode && NEXT_BLKP(bp) == ar->brk_end) {
+        ar->wild = bp;
+        return bp;
+    }
+    if (IS_TREE(size)) {
+        ar->tree = tree_insert(ar->tree, bp);
+        return bp;
+    }
+
+    char *sent = SENTINEL(index);
+    char *nextBp;
+
+    ar->sl_bitmap[index >> SL_LOG] |= 1U << (index & (SL_COUNT - 1));
+    ar->fl_bitmap |= 1U << (index >> SL_LOG);
+
+    switch (list_policy)
+    {
+        case LIST_LIFO:
+            nextBp = GET_SUCC(sent);
+            break;
+        case LIST_FIFO:
+            nextBp = sent;
+            break;
+        default:
+            /* 哨兵位于所有块之前, 先检查表尾以保持顺序释放为 O(1) */
+            nextBp = sent;
+            if (GET_PRED(sent) != sent && GET_PRED(sent) > (char *)bp){
+                nextBp = GET_SUCC(sent);
+                while (nextBp < (char *)bp) {
+                    PROF_PROBE();
+                    nextBp = GET_SUCC(nextBp);
+                }
+            }
+            break;
+    }
+    char *prevBp = GET_PRED(nextBp);
+    PUT_SUCC(prevBp, bp);
+    PUT_PRED(bp, prevBp);
+    PUT_SUCC(bp, nextBp);
+    PUT_PRED(nextBp, bp);
+
+    return bp;
 }
 
 /**
- * @brief deleteNode - Delete a block from the list
+ * @brief deleteNode - Delete a block from the list,
+ *          哨兵保证前驱后继总是存在; 前驱后继都是哨兵时链表变空, 清除位图
  * @param   {void *}    bp
  * @return  {void}      no return
  */
 static inline void deleteNode(void *bp){
-        int type=getType(bp);
-        int i=getIndex(THIS_SIZE(bp));
+    size_t size = THIS_SIZE(bp);
+    int index = getIndex(size);
 
-        switch (type)
-        {
-            case ALLNULL:
-                free_head[i] = free_tail[i] = (size_t)NULL;
-                break;
-            case HEADNULL:
-                free_head[i] = (size_t)GET_SUCC(bp);
-                break;
-            case TAILNULL:
-                free_tail[i] = (size_t)GET_PRED(bp);
-                break;
-            case NORMAL:
-                PUT_PRED(GET_SUCC(bp),GET_PRED(bp));
-                PUT_SUCC(GET_PRED(bp),GET_SUCC(bp));
-                break;
-        }
+    ar->cls_count[index]--;
+    ar->cls_bytes[index] -= size;
+    ar->free_bytes -= size;
+    if (bp == ar->wild) {
+        ar->wild = NULL;
+        return;
+    }
+    if (IS_TREE(size)) {
+        ar->tree = tree_delete(ar->tree, bp);
+        return;
+    }
+
+    char *prevBp = GET_PRED(bp);
+    char *nextBp = GET_SUCC(bp);
+    if (ar->rover && ar->rover[index] == bp)
+        ar->rover[index] = nextBp;
+    PUT_SUCC(prevBp, nextBp);
+    PUT_PRED(nextBp, prevBp);
+
+    if (prevBp == nextBp && IS_SENTINEL(prevBp)) {
+        if (!(ar->sl_bitmap[index >> SL_LOG] &= ~(1U << (index & (SL_COUNT - 1)))))
+            ar->fl_bitmap &= ~(1U << (index >> SL_LOG));
+    }
 }
 
 /**
- * @brief getIndex - Get the target list with proper size
+ * @brief getIndex - Get the target list with proper size: seg class i
+ *          holds sizes in (seg_bound[i-1], seg_bound[i]]
  * @param   {size_t}    size
- * @return  {int}       success  ->  size所对应应分配的大小
- *                      fail     ->  -1 (control never reaches here)
+ * @return  {int}       size所对应的链表
  */
 static inline int getIndex(size_t size){
+    if (index_mode == INDEX_TLSF)
+        return tlsfIndex(size);
+    if (index_mode == INDEX_EXACT)
+        return exactIndex(size);
     if (size<=(1<<4))
         return 0;
     if (size>(1<<22))
-        return 19;
-    int i=4;
-    unsigned int nowSize=(1<<4);
+        return NCLASSES - 1;
+    /* size-1 的最高位定出 2 的幂区间, 其下 SEG_SUB_LOG 位定出子类 */
+    size_t s = size - 1;
+    int m = 63 - __builtin_clzll(s);
+    return 1 + (m - 4) * SEG_SUB + ((s >> (m - SEG_SUB_LOG)) & (SEG_SUB - 1));
+}
 
-    for (i=5;i<=23;++i)
-    {
-        nowSize<<=1;
-        if (size<=nowSize){
-            return i-4;
-        }
-    }
-    return -1; /* control never reaches here ; to avoid warning */
+/**
+ * @brief tlsfIndex - Map a size to its TLSF class: fl is the power of
+ *          two, sl the next SL_LOG bits below the leading one
+ * @param   {size_t}    size
+ * @return  {int}       fl * SL_COUNT + sl
+ */
+static inline int tlsfIndex(size_t size){
+    if (size < (1 << FL_SHIFT))
+        return size >> 3;
+    int msb = 63 - __builtin_clzll(size);
+    int fl = msb - FL_SHIFT + 1;
+    if (fl >= FL_COUNT)
+        return TLSF_CLASSES - 1;
+    return (fl << SL_LOG) + ((size >> (msb - SL_LOG)) & (SL_COUNT - 1));
+}
+
+/**
+ * @brief exactIndex - Map a size to its exact bin, or to the power-of-two
+ *          class above EXACT_MAX that holds it
+ * @param   {size_t}    size
+ * @return  {int}       size / 8 或 EXACT_BINS + 级数
+ */
+static inline int exactIndex(size_t size){
+    if (size <= EXACT_MAX)
+        return size >> 3;
+    int i = EXACT_BINS + (63 - __builtin_clzll(size - 1)) - 9;
+    return (i < EXACT_CLASSES) ? i : EXACT_CLASSES - 1;
+}
+
+/**
+ * @brief grow_size - How far to extend the heap for a block of bytes:
+ *          GROW_FIXED at least CHUNKSIZE; GROW_ADAPT at least ar->grow,
+ *          doubled when the last extension was under GROW_WINDOW mallocs
+ *          ago and halved for every quiet window since
+ * @param   {size_t}    bytes
+ * @return  {size_t}    扩展的字节数
+ */
+static size_t grow_size(size_t bytes)
+{
+    unsigned long quiet = (ar->allocs - ar->last_grow) / GROW_WINDOW;
+    size_t cap;
+
+    if (grow_mode == GROW_FIXED)
+        return MAX(bytes, CHUNKSIZE);
+
+    ar->last_grow = ar->allocs;
+    if (quiet == 0)
+        ar->grow <<= 1;
+    else
+        ar->grow >>= (quiet < 16) ? quiet : 16;
+    /* 超出请求的部分不超过堆的 grow_budget% */
+    cap = ALIGN(bytes + mem_heapsize() / 100 * grow_budget);
+    if (ar->grow > cap)
+        ar->grow = cap;
+    if (ar->grow < CHUNKSIZE)
+        ar->grow = CHUNKSIZE;
+    ar->grow = ALIGN(ar->grow);
+    return MAX(bytes, ar->grow);
 }
 
 /**
@@ -565,23 +2713,495 @@ static inline int getIndex(size_t size){
  */
 static void *extend_heap(size_t words) 
 {
+    PROF_PHASE(MM_PHASE_EXTEND);
     char *bp;
 
     /* Allocate an even number of words to maintain alignment */
     words = (words % 2) ? (words+1): words; 
+#ifdef MM_THREADS
+    /* 多要 4 WSIZE: 若别的 arena 抢先扩展过, 新段需要自己的序言块 */
+    if ((long)(bp = mem_sbrk(words + 4 * WSIZE)) == -1)  
+        return NULL;                                        
+    if (bp != ar->brk_end) {
+        PUT(bp, 0);                             /* Alignment padding */
+        PUT(bp + 1 * WSIZE, PACK(DSIZE, 1));    /* Prologue header */ 
+        PUT(bp + 2 * WSIZE, PACK(DSIZE, 1));    /* Prologue footer */ 
+        bp += 4 * WSIZE;
+        PUT(HDRP(bp), PREV_ALLOC);
+    }
+    else
+        words += 4 * WSIZE;
+#else
     if ((long)(bp = mem_sbrk(words)) == -1)  
         return NULL;                                        
+#endif
+    ar->extends++;
+    ar->block_bytes += words;
+    EV_FLAG(MM_EV_EXTEND);
+
+    /* 与 wilderness 相连时直接把它加长 */
+    if (ar->wild && NEXT_BLKP(ar->wild) == bp) {
+        bp = ar->wild;
+        deleteNode(bp);
+        SET_FREE(bp, THIS_SIZE(bp) + words);
+        PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1));
+        ar->brk_end = NEXT_BLKP(bp);
+        return insertNode(bp);
+    }
 
     /* Initialize free block header/footer and the epilogue header */
-    PUT(HDRP(bp), PACK(words, 0));         /* Free block header */   
-    PUT(FTRP(bp), PACK(words, 0));         /* Free block footer */   
+    SET_FREE(bp, words);                   /* Free block header/footer */   
     PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1)); /* New epilogue header */ 
+    ar->brk_end = NEXT_BLKP(bp);
+
+    /* 旧段尾的 wilderness 不再挨着结尾块, 回到链表 */
+    if (ar->wild) {
+        char *old = ar->wild;
+        ar->wild = NULL;
+        insertNode(old);
+    }
 
     /* 插入节点顺便整合 */
     return insertNode(bp);  
                                          
 }
 
+/**
+ * @brief aligned_bp - First align boundary at or after bp that leaves
+ *          either no gap or room for a free block in front of it
+ * @param   {char *}    bp
+ *          {size_t}    align
+ * @return  {char *}    对齐后的块指针
+ */
+static inline char *aligned_bp(char *bp, size_t align)
+{
+    char *abp = (char *)(((size_t)bp + align - 1) & ~(align - 1));
+    if (abp != bp && abp - bp < BLOCKSIZE)
+        abp += align;
+    return abp;
+}
+
+/**
+ * @brief trim_heap - If the free block bp is the last one of the heap
+ *          and exceeds the top pad (trim_threshold rounded up to
+ *          CHUNKSIZE) by at least trim_threshold bytes, give the excess
+ *          back to memlib and keep the pad as a free block
+ * @param   {void *}    bp
+ * @return  {void}      no return
+ */
+static void trim_heap(void *bp)
+{
+#ifndef MM_THREADS
+    size_t size = THIS_SIZE(bp);
+    size_t pad = (trim_threshold + CHUNKSIZE - 1) / CHUNKSIZE * CHUNKSIZE;
+    size_t excess;
+
+    /* 留下余量, 堆反复伸缩时不必每次都 sbrk */
+    if (size < pad + trim_threshold || NEXT_BLKP(bp) != ar->brk_end)
+        return;
+    excess = (size - pad) & ~(size_t)(ALIGNMENT - 1);
+    deleteNode(bp);
+    if (mem_sbrk(-(intptr_t)excess) == (void *)-1) {
+        insertNode(bp);
+        return;
+    }
+    SET_FREE(bp, size - excess);
+    PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1));
+    ar->brk_end = NEXT_BLKP(bp);
+    ar->block_bytes -= excess;
+    insertNode(bp);
+#endif
+}
+
+/**
+ * @brief purge_block - Purge the whole pages of a free block between its
+ *          links and its footer, and mark it PURGED
+ * @param   {void *}    bp
+ * @return  {void}      no return
+ */
+static void purge_block(void *bp)
+{
+    purge_range(bp, bp, FTRP(bp));
+}
+
+/**
+ * @brief purge_range - Purge the whole pages between the links and the
+ *          footer of free block bp that touch [lo, hi), and mark bp
+ *          PURGED; the rest of bp must be purged already (or be the dead
+ *          tags and links of blocks merged into it)
+ * @param   {void *}    bp
+ *          {char *}    lo
+ *          {char *}    hi
+ * @return  {void}      no return
+ */
+static void purge_range(void *bp, char *lo, char *hi)
+{
+    size_t pagesize = mem_pagesize();
+    char *first = (char *)(((size_t)bp + DSIZE + pagesize - 1) & ~(pagesize - 1));
+    char *last = (char *)((size_t)FTRP(bp) & ~(pagesize - 1));
+
+    /* 与 [lo, hi) 相交的页都清, 但不碰 bp 自己的链接和尾部 */
+    lo = MAX((char *)((size_t)lo & ~(pagesize - 1)), first);
+    hi = MIN((char *)(((size_t)hi + pagesize - 1) & ~(pagesize - 1)), last);
+    if (lo < hi)
+        mem_purge(lo, hi - lo);
+    PUT(HDRP(bp), GET(HDRP(bp)) | PURGED);
+}
+
+/**
+ * @brief purge_sweep - Purge every free block of arena ar that is at
+ *          least purge_threshold bytes and not purged yet
+ * @param   {void}      no param
+ * @return  {void}      no return
+ */
+static void purge_sweep(void)
+{
+    char *curBp;
+    int i;
+
+    for (i = getIndex(purge_threshold); i < nclasses; ++i)
+        for (curBp = GET_SUCC(SENTINEL(i)); curBp != SENTINEL(i); curBp = GET_SUCC(curBp))
+            if (THIS_SIZE(curBp) >= purge_threshold && !(GET(HDRP(curBp)) & PURGED))
+                purge_block(curBp);
+    purge_tree(ar->tree);
+    if (ar->wild && THIS_SIZE(ar->wild) >= purge_threshold &&
+        !(GET(HDRP(ar->wild)) & PURGED))
+        purge_block(ar->wild);
+}
+
+/**
+ * @brief purge_tree - purge_sweep for the blocks of a (sub)tree
+ * @param   {char *}    node
+ * @return  {void}      no return
+ */
+static void purge_tree(char *node)
+{
+    for (; node != NULL; node = GET_RIGHT(node)) {
+        if (THIS_SIZE(node) < purge_threshold)
+            continue;
+        purge_tree(GET_LEFT(node));
+        if (!(GET(HDRP(node)) & PURGED))
+            purge_block(node);
+    }
+}
+
+#ifdef MM_THREADS
+/**
+ * @brief purge_main - Background sweeper: every PURGE_MS purge each
+ *          arena under its lock, until purge_stop
+ * @param   {void *}    unused
+ * @return  {void *}    NULL
+ */
+static void *purge_main(void *unused)
+{
+    struct timespec ts;
+    arena_t *a;
+    int i;
+
+    pthread_mutex_lock(&purge_lock);
+    while (!purger_stop) {
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_nsec += PURGE_MS * 1000000L;
+        if (ts.tv_nsec >= 1000000000L) {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000L;
+        }
+        pthread_cond_timedwait(&purge_cond, &purge_lock, &ts);
+        if (purger_stop)
+            break;
+        pthread_mutex_unlock(&purge_lock);
+        for (i = 0; i < MM_ARENAS; i++) {
+            pthread_mutex_lock(&arenas_lock);
+            a = arenas[i];
+            pthread_mutex_unlock(&arenas_lock);
+            if (a != NULL) {
+                ENTER(a);
+                purge_sweep();
+                LEAVE();
+            }
+        }
+        pthread_mutex_lock(&purge_lock);
+    }
+    pthread_mutex_unlock(&purge_lock);
+    return NULL;
+}
+
+/**
+ * @brief purge_stop - Stop the sweeper and wait for it; memlib calls
+ *          this before the heap is reset or unmapped
+ * @param   {void}      no param
+ * @return  {void}      no return
+ */
+static void purge_stop(void)
+{
+    if (!purger_on)
+        return;
+    pthread_mutex_lock(&purge_lock);
+    purger_stop = 1;
+    pthread_cond_signal(&purge_cond);
+    pthread_mutex_unlock(&purge_lock);
+    pthread_join(purger, NULL);
+    purger_on = 0;
+}
+#endif
+
+/**
+ * @brief alloc_aligned - Allocate a block of bytes (overhead included)
+ *          whose payload starts on an align boundary (power of two).
+ *          The padding in front is split off as a free block.
+ * @param   {size_t}    bytes
+ *          {size_t}    align
+ * @return  {void *}    success  ->  已分配块的指针
+ *                      fail     ->  NULL
+ */
+static void *alloc_aligned(size_t bytes, size_t align)
+{
+    char *bp, *abp;
+    size_t csize;
+
+    /* 先看刚好够大的块是否碰巧对齐, 再找保证够用的块 */
+    if ((bp = find_fit(bytes)) != NULL &&
+        aligned_bp(bp, align) + bytes > bp + THIS_SIZE(bp))
+        bp = NULL;
+    if (bp == NULL &&
+        (bp = find_fit(bytes + align + BLOCKSIZE)) == NULL && ar->fast_bytes) {
+        consolidate();
+        bp = find_fit(bytes + align + BLOCKSIZE);
+    }
+    if (bp == NULL && ar->wild && THIS_SIZE(ar->wild) >= bytes + align + BLOCKSIZE)
+        bp = ar->wild;
+    if (bp == NULL) {
+        /* 新块从当前堆顶开始, 只扩展对齐所需的部分 */
+        bp = ar->brk_end;
+        if ((bp = extend_heap(aligned_bp(bp, align) - bp + bytes)) == NULL)
+            return NULL;
+        /* 别的 arena 抢先扩展过时新块不在预期的位置 */
+        if (aligned_bp(bp, align) + bytes > bp + THIS_SIZE(bp) &&
+            (bp = extend_heap(bytes + align + BLOCKSIZE)) == NULL)
+            return NULL;
+    }
+    abp = aligned_bp(bp, align);
+
+    if (abp != bp) {
+        /* 前面的空隙成为一个空闲块 */
+        csize = THIS_SIZE(bp);
+        deleteNode(bp);
+        SET_FREE(bp, abp - bp);
+        insertNode(bp);
+        PUT(HDRP(abp), PACK(csize - (abp - bp), 0));
+        PUT(FTRP(abp), PACK(csize - (abp - bp), 0));
+        insertNode(abp);
+    }
+    return place(abp, bytes);
+}
+
+/**
+ * @brief alloc_batch - Cut n blocks of bytes (overhead included) into
+ *          out: quick-list blocks first, then runs of blocks from one
+ *          free block, the wilderness or a heap extension at a time.
+ *          Only the last block of a run splits off a free remainder
+ * @param   {size_t}    bytes
+ *          {size_t}    n
+ *          {void **}   out
+ * @return  {size_t}    分配到的块数
+ */
+static size_t alloc_batch(size_t bytes, size_t n, void **out)
+{
+    size_t got = 0, need, csize, k, extendsize;
+    char *bp;
+
+    while (got < n && FAST_BIN(bytes) < fast_bins &&
+           (bp = ar->fast[FAST_BIN(bytes)]) != NULL) {
+        ar->fast[FAST_BIN(bytes)] = *(char **)bp;
+        ar->fast_bytes -= bytes;
+        out[got++] = bp;
+    }
+    while (got < n) {
+        /* 比整个堆还大的一批放不下, 这样 bytes * n 也不会溢出 */
+        need = bytes * MIN(n - got, mem_maxsize() / bytes);
+        /* 够放全部的块, 否则至少能放一块的块 */
+        if ((bp = find_fit(need)) == NULL && ar->fast_bytes) {
+            consolidate();
+            bp = find_fit(need);
+        }
+        if (bp == NULL)
+            bp = find_fit(bytes);
+        if (bp == NULL && ar->wild && THIS_SIZE(ar->wild) >= bytes)
+            bp = ar->wild;
+        if (bp == NULL) {
+            extendsize = grow_size(need);
+            if (ar->wild)
+                extendsize = MAX(extendsize - THIS_SIZE(ar->wild), BLOCKSIZE);
+            if ((bp = extend_heap(extendsize)) == NULL)
+                break;
+            /* 没接上 wilderness 的小段留给下一轮 */
+            if (THIS_SIZE(bp) < bytes)
+                continue;
+        }
+        csize = THIS_SIZE(bp);
+        k = MIN(csize / bytes, n - got);
+        ar->allocs += k;
+        deleteNode(bp);
+        for (; k > 1; k--) {
+            SET_ALLOC(bp, bytes);
+            out[got++] = bp;
+            bp = NEXT_BLKP(bp);
+            csize -= bytes;
+            SET_PREV_ALLOC(bp);
+        }
+        trim_block(bp, csize, bytes);
+        out[got++] = bp;
+    }
+    return got;
+}
+
+/**
+ * @brief addr_cmp - qsort order of block pointers by address
+ * @param   {const void *}  a
+ *          {const void *}  b
+ * @return  {int}   -1 / 0 / 1
+ */
+static int addr_cmp(const void *a, const void *b)
+{
+    char *x = *(char * const *)a, *y = *(char * const *)b;
+
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief slab_alloc - Take a free slot from the first partial run of the
+ *          size's class, making a new run if the class has none
+ * @param   {size_t}    size
+ * @return  {void *}    success  ->  对象指针
+ *                      fail     ->  NULL
+ */
+static void *slab_alloc(size_t size)
+{
+    int cls = size ? (size - 1) / DSIZE : 0;
+    slab_run *run = ar->slab_partial[cls];
+    int w = 0, i;
+
+    if (run == NULL && (run = new_run(cls)) == NULL)
+        return NULL;
+    while (!run->freemap[w])
+        ++w;
+    i = __builtin_ctzll(run->freemap[w]);
+    run->freemap[w] &= run->freemap[w] - 1;
+
+    /* 用完的 run 离开 partial 链表 */
+    if (--run->nfree == 0) {
+        ar->slab_partial[cls] = run->next;
+        if (run->next)
+            run->next->prev = NULL;
+    }
+    return (char *)run + RUN_HDRSIZE + (w * 64 + i) * run->size;
+}
+
+/**
+ * @brief slab_free - Return an object to its run. A run that becomes
+ *          empty goes back to the heap unless it is the class's last
+ *          partial run.
+ * @param   {void *}    p
+ * @return  {void}      no return
+ */
+static void slab_free(void *p)
+{
+    slab_run *run = RUN_OF(p);
+    int i = ((char *)p - (char *)run - RUN_HDRSIZE) / run->size;
+
+    run->freemap[i >> 6] |= 1ULL << (i & 63);
+    if (run->nfree++ == 0) {
+        run->prev = NULL;
+        run->next = ar->slab_partial[run->cls];
+        if (run->next)
+            run->next->prev = run;
+        ar->slab_partial[run->cls] = run;
+    }
+    else if (run->nfree == run->nobjs && (run->prev || run->next)) {
+        if (run->prev)
+            run->prev->next = run->next;
+        else
+            ar->slab_partial[run->cls] = run->next;
+        if (run->next)
+            run->next->prev = run->prev;
+        mark_run(run, 0);
+        free_block(run);
+    }
+}
+
+/**
+ * @brief new_run - Carve a page-aligned run for class cls out of the
+ *          heap and make it the class's only partial run
+ * @param   {int}   cls
+ * @return  {slab_run *}    success  ->  新 run
+ *                          fail     ->  NULL
+ */
+static slab_run *new_run(int cls)
+{
+    slab_run *run;
+    int i;
+
+    if ((run = alloc_aligned(ALIGN(RUN_SIZE + INFOSIZE), RUN_SIZE)) == NULL)
+        return NULL;
+    if (mark_run(run, 1) < 0) {
+        free_block(run);
+        return NULL;
+    }
+    run->next = run->prev = NULL;
+    run->arena = ar;
+    run->cls = cls;
+    run->size = (cls + 1) * DSIZE;
+    run->nobjs = run->nfree = (RUN_SIZE - RUN_HDRSIZE) / run->size;
+    memset(run->freemap, 0, sizeof(run->freemap));
+    for (i = 0; i < run->nobjs / 64; ++i)
+        run->freemap[i] = ~0ULL;
+    if (run->nobjs % 64)
+        run->freemap[i] = (1ULL << (run->nobjs % 64)) - 1;
+    ar->slab_partial[cls] = run;
+    return run;
+}
+
+/**
+ * @brief mark_run - Set or clear the run_map bit of a run's page,
+ *          growing run_map (a heap block itself) to cover it if needed
+ * @param   {void *}    run
+ *          {int}       on
+ * @return  {int}   success ->   0
+ *                  fail    ->   -1
+ */
+static int mark_run(void *run, int on)
+{
+    size_t page = ((char *)run - heap_lo) >> RUN_SHIFT;
+
+    if (page >= run_map_pages) {
+        /* 每次至少翻倍, 以 1024 页 (128 字节) 为单位 */
+        size_t pages = MAX(2 * run_map_pages, (page + 1024) & ~(size_t)1023);
+        unsigned char *map = alloc_block(pages / 8);
+        if (map == NULL)
+            return -1;
+        memset(map, 0, pages / 8);
+        if (run_map) {
+            memcpy(map, run_map, run_map_pages / 8);
+            free_block(run_map);
+        }
+        run_map = map;
+        run_map_pages = pages;
+    }
+#ifdef MM_THREADS
+    /* 同一字节可能记录着别的 arena 的 run */
+    if (on)
+        __atomic_or_fetch(&run_map[page >> 3], 1 << (page & 7), __ATOMIC_RELAXED);
+    else
+        __atomic_and_fetch(&run_map[page >> 3], ~(1 << (page & 7)), __ATOMIC_RELAXED);
+#else
+    if (on)
+        run_map[page >> 3] |= 1 << (page & 7);
+    else
+        run_map[page >> 3] &= ~(1 << (page & 7));
+#endif
+    return 0;
+}
+
 /**
  * @brief  in_heap - Return whether the pointer is in the heap.(useful for debugging)
  * @param   {const void *}  p
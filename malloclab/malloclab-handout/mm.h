@@ -1,4 +1,24 @@
 #include <stdio.h>
+#include <stdlib.h>     /* 先于下面的 malloc 宏声明 libc 的 malloc */
+
+/* Block rounding of mm.c (which checks that the two agree), so that
+ * the inline path below folds constant sizes at compile time */
+#ifdef MM_LARGE
+#define MM_WSIZE        8
+#else
+#define MM_WSIZE        4
+#endif
+#ifdef FOOTER_ELISION
+#define MM_INFOSIZE     MM_WSIZE
+#else
+#define MM_INFOSIZE     (2 * MM_WSIZE)
+#endif
+#define MM_BLOCKSIZE    (4 * MM_WSIZE)
+#define MM_ALIGNMENT    (2 * MM_WSIZE)
+/* 请求 size 字节时的块大小, 及其 tcache / quick list 的 bin */
+#define MM_BYTES(size)  ((size_t)(size) + MM_INFOSIZE <= MM_BLOCKSIZE ? (size_t)MM_BLOCKSIZE : \
+                         ((size_t)(size) + MM_INFOSIZE + MM_ALIGNMENT - 1) & ~(size_t)(MM_ALIGNMENT - 1))
+#define MM_BIN(size)    ((MM_BYTES(size) - MM_BLOCKSIZE) / MM_ALIGNMENT)
 
 #ifdef DRIVER
 
@@ -7,6 +27,14 @@ extern void *mm_malloc (size_t size);
 extern void mm_free (void *ptr);
 extern void *mm_realloc(void *ptr, size_t size);
 extern void *mm_calloc (size_t nmemb, size_t size);
+extern void *mm_memalign(size_t alignment, size_t size);
+extern int mm_posix_memalign(void **memptr, size_t alignment, size_t size);
+extern void *mm_aligned_alloc(size_t alignment, size_t size);
+extern void mm_free_sized(void *ptr, size_t size);
+extern size_t mm_malloc_usable_size(void *ptr);
+extern size_t mm_malloc_batch(size_t size, size_t n, void **out);
+extern void mm_free_batch(void **ptrs, size_t n);
+extern void *mm_malloc_fixed(size_t size, size_t bytes, size_t bin);
 
 #else
 
@@ -15,10 +43,118 @@ extern void *malloc (size_t size);
 extern void free (void *ptr);
 extern void *realloc(void *ptr, size_t size);
 extern void *calloc (size_t nmemb, size_t size);
+extern void *memalign(size_t alignment, size_t size);
+extern int posix_memalign(void **memptr, size_t alignment, size_t size);
+extern void *aligned_alloc(size_t alignment, size_t size);
+extern void free_sized(void *ptr, size_t size);
+extern size_t malloc_usable_size(void *ptr);
+extern size_t malloc_batch(size_t size, size_t n, void **out);
+extern void free_batch(void **ptrs, size_t n);
+extern void *malloc_fixed(size_t size, size_t bytes, size_t bin);
 
 #endif
 
+/* Constant sizes (sizeof(struct X)) skip the rounding at run time and
+ * go straight to malloc_fixed; mm.c defines MM_NO_INLINE */
+#if defined(__GNUC__) && !defined(MM_NO_INLINE)
+#ifdef DRIVER
+#define mm_malloc(size) (__builtin_constant_p(size) ? \
+        mm_malloc_fixed((size), MM_BYTES(size), MM_BIN(size)) : (mm_malloc)(size))
+#else
+#define malloc(size)    (__builtin_constant_p(size) ? \
+        malloc_fixed((size), MM_BYTES(size), MM_BIN(size)) : (malloc)(size))
+#endif
+#endif
+
 extern int mm_init(void);
 
+/* Run-time tuning knobs; return 0 on success, -1 on unknown name/value. */
+extern int mm_setopt(const char *name, const char *value);
+
+/* tcache hits and misses since mm_init (drained caches + the caller's). */
+extern void mm_tcache_stats(unsigned long *hits, unsigned long *misses);
+
+/* Heap statistics, kept up to date as blocks move, so that
+ * mm_get_stats costs O(classes). Block sizes include their overhead */
+#define MM_STAT_CLASSES 256     /* classes of the largest index mode */
+typedef struct {
+    size_t heap_bytes;          /* heap size */
+    size_t mapped_bytes;        /* regions of mapped blocks */
+    size_t live_bytes;          /* allocated heap blocks, tcaches and slab runs included */
+    size_t free_bytes;          /* free heap blocks */
+    size_t cached_bytes;        /* freed blocks waiting in the quick lists */
+    size_t largest_free;        /* biggest free block, 0 if none */
+    unsigned long extends;      /* heap extensions */
+    unsigned long splits;       /* free remainders split off allocated blocks */
+    unsigned long coalesces[4]; /* frees by coalescing case 1..4 */
+    int nclasses;               /* classes of the index mode */
+    unsigned long class_count[MM_STAT_CLASSES]; /* free blocks per class */
+    size_t class_bytes[MM_STAT_CLASSES];
+} mm_stats_t;
+
+/* Fill *st with the statistics of every arena since mm_init. */
+extern void mm_get_stats(mm_stats_t *st);
+
+/* Phase profile of -DMM_PROFILE builds: cycles and blocks looked at
+ * (probes) per call of each phase, nested calls included. Histogram
+ * bucket 0 counts zeros, bucket b values in [2^(b-1), 2^b) */
+#define MM_PHASE_FIT        0   /* find_fit */
+#define MM_PHASE_INSERT     1   /* insertNode */
+#define MM_PHASE_COALESCE   2   /* coalesce */
+#define MM_PHASE_EXTEND     3   /* extend_heap */
+#define MM_PHASES           4
+#define MM_PROF_BUCKETS     32
+typedef struct {
+    unsigned long calls[MM_PHASES];
+    unsigned long long cycles[MM_PHASES];       /* total */
+    unsigned long long max_cycles[MM_PHASES];
+    unsigned long cycle_hist[MM_PHASES][MM_PROF_BUCKETS];
+    unsigned long probe_hist[MM_PHASES][MM_PROF_BUCKETS];
+} mm_profile_t;
+
+/* Fill *p with the profile since mm_init; -1 if not built with MM_PROFILE. */
+extern int mm_get_profile(mm_profile_t *p);
+
+/* Event trace of -DMM_EVENTS builds: a ring of the last MM_EV_RING
+ * events, each public call one event; mm_flush_events writes those not
+ * yet written as an mm_event_hdr_t and its events (see mmevents.c) */
+#define MM_EV_RING          (1 << 16)
+#define MM_EV_MALLOC        0
+#define MM_EV_FREE          1
+#define MM_EV_REALLOC       2
+#define MM_EV_MEMALIGN      3
+#define MM_EV_FREE_SIZED    4
+#define MM_EV_MALLOC_BATCH  5   /* size: bytes of all the blocks */
+#define MM_EV_FREE_BATCH    6
+#define MM_EV_COUNTER       7   /* cls: MM_CTR_* or a class; addr: value */
+#define MM_EV_OPS           8
+#define MM_EV_SPLIT         0x1 /* flags: a free remainder was split off */
+#define MM_EV_COALESCE      0x2 /* ... a block merged with a neighbour */
+#define MM_EV_EXTEND        0x4 /* ... the heap was extended */
+#define MM_CTR_HEAP         (-1)    /* heap + mapped bytes */
+#define MM_CTR_LIVE         (-2)    /* allocated bytes of the arena */
+#define MM_CTR_FREE         (-3)    /* free bytes of the arena */
+typedef struct {
+    unsigned long long ts;      /* start, in ticks since mm_init */
+    unsigned int dur;           /* ticks */
+    unsigned int size;          /* requested bytes, 0 if unknown */
+    unsigned long addr;         /* block returned (or freed) */
+    unsigned short probes;      /* blocks looked at, at most 65535 */
+    unsigned char op;
+    unsigned char flags;
+    short cls;                  /* class of the block, -1 if none */
+    unsigned short thread;      /* calling thread (counters: arena) */
+} mm_event_t;
+typedef struct {
+    char magic[4];              /* "MMEV" */
+    unsigned int epoch;         /* mm_init calls so far */
+    unsigned int count;         /* events that follow */
+    unsigned int lost;          /* events overwritten before this flush */
+    double ticks_per_us;
+} mm_event_hdr_t;
+
+/* Write the new events to f; -1 if not built with MM_EVENTS. */
+extern long mm_flush_events(FILE *f);
+
 /* This is largely for debugging. */
 extern void mm_checkheap(int lineno);
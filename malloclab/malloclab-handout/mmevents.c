@@ -0,0 +1,114 @@
+/*
+ * mmevents.c - Convert the events an MM_EVENTS build of mm.c wrote
+ * (mdriver -E, or mm_flush_events) to Chrome trace-event JSON, which
+ * chrome://tracing and ui.perfetto.dev open:
+ *
+ *      mmevents events.bin > events.json
+ *
+ * Every public call becomes a complete ("X") event on the track of
+ * its thread, one process per mm_init; counters become "C" tracks.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MM_NO_INLINE
+#include "mm.h"
+
+static const char *op_names[MM_EV_OPS] = {
+    "malloc", "free", "realloc", "memalign", "free_sized",
+    "malloc_batch", "free_batch", "counter"
+};
+
+static int first = 1;   /* no event written yet */
+
+/*
+ * sep - Start the next element of traceEvents
+ */
+static void sep(void)
+{
+    printf(first ? "\n" : ",\n");
+    first = 0;
+}
+
+/*
+ * print_counter - Write one counter record as a "C" event
+ */
+static void print_counter(const mm_event_hdr_t *h, const mm_event_t *e)
+{
+    char name[64];
+
+    if (e->cls == MM_CTR_HEAP)
+        strcpy(name, "heap bytes");
+    else if (e->cls == MM_CTR_LIVE)
+        strcpy(name, "live bytes");
+    else if (e->cls == MM_CTR_FREE)
+        strcpy(name, "free bytes");
+    else
+        sprintf(name, "class %d free blocks", e->cls);
+    /* 堆大小是全局的, 其余按 arena 分开 */
+    if (e->thread && e->cls != MM_CTR_HEAP)
+        sprintf(name + strlen(name), " (arena %u)", e->thread);
+    sep();
+    printf("{\"name\":\"%s\",\"ph\":\"C\",\"pid\":%u,\"ts\":%.3f,"
+           "\"args\":{\"value\":%lu}}",
+           name, h->epoch, e->ts / h->ticks_per_us, e->addr);
+}
+
+/*
+ * print_event - Write one call as an "X" event
+ */
+static void print_event(const mm_event_hdr_t *h, const mm_event_t *e)
+{
+    sep();
+    printf("{\"name\":\"%s\",\"cat\":\"mm\",\"ph\":\"X\",\"pid\":%u,\"tid\":%u,"
+           "\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"size\":%u,\"addr\":\"0x%lx\","
+           "\"class\":%d,\"probes\":%u,\"split\":%d,\"coalesce\":%d,\"extend\":%d}}",
+           op_names[e->op], h->epoch, e->thread,
+           e->ts / h->ticks_per_us, e->dur / h->ticks_per_us,
+           e->size, e->addr, e->cls, e->probes,
+           !!(e->flags & MM_EV_SPLIT), !!(e->flags & MM_EV_COALESCE),
+           !!(e->flags & MM_EV_EXTEND));
+}
+
+int main(int argc, char **argv)
+{
+    FILE *f;
+    mm_event_hdr_t h;
+    mm_event_t e;
+    unsigned int i;
+
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s <event file> > <trace.json>\n", argv[0]);
+        exit(1);
+    }
+    if ((f = fopen(argv[1], "rb")) == NULL) {
+        perror(argv[1]);
+        exit(1);
+    }
+
+    printf("{\"traceEvents\":[");
+    /* 每次 flush 写一个头和它的事件 */
+    while (fread(&h, sizeof(h), 1, f) == 1) {
+        if (memcmp(h.magic, "MMEV", 4) != 0 || h.ticks_per_us <= 0) {
+            fprintf(stderr, "%s: not an mm event file\n", argv[1]);
+            exit(1);
+        }
+        if (h.lost)
+            fprintf(stderr, "%s: %u events of mm_init %u were overwritten\n",
+                    argv[1], h.lost, h.epoch);
+        for (i = 0; i < h.count; i++) {
+            if (fread(&e, sizeof(e), 1, f) != 1) {
+                fprintf(stderr, "%s: truncated\n", argv[1]);
+                exit(1);
+            }
+            if (e.op == MM_EV_COUNTER)
+                print_counter(&h, &e);
+            else if (e.op < MM_EV_OPS)
+                print_event(&h, &e);
+        }
+    }
+    printf("\n]}\n");
+    fclose(f);
+    return 0;
+}